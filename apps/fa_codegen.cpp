@@ -0,0 +1,251 @@
+/*
+ * mygrep - A custom implementation of the grep utility.
+ * Copyright (C) 2026  Marto Nievas
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * fa_codegen: compiles a REGEX ahead of time into a standalone C++ header.
+ * The minimized DFA becomes one label per state and a switch over byte
+ * classes that jumps straight to the next label, so the generated matcher
+ * needs neither this library nor a transition table at runtime.
+ */
+
+#include "../include/fa/parser/parser.hpp"
+#include "../include/fa/regex/compiled.hpp"
+#include "../include/fa/regex/regex.hpp"
+#include <cctype>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+using namespace fa::regex;
+
+struct Options {
+  string name = "matcher";
+  string name_space = "fa_generated";
+  bool prefix_skip = true;
+  CompileOptions compile;
+  string regex;
+  string output; // stdout when empty
+  bool valid = false;
+};
+
+static bool is_identifier(string_view s) {
+  if (s.empty() || isdigit((unsigned char)s[0]))
+    return false;
+  for (char c : s)
+    if (!isalnum((unsigned char)c) && c != '_')
+      return false;
+  return true;
+}
+
+static Options parse_args(int argc, char **argv) {
+  Options opts;
+  vector<string_view> positional;
+
+  for (int i = 1; i < argc; i++) {
+    string_view arg(argv[i]);
+    if (arg == "--no-prefix-skip") {
+      opts.prefix_skip = false;
+    } else if (arg == "-i" || arg == "--ignore-case") {
+      opts.compile.ignore_case = true;
+    } else if (arg == "--name" || arg == "--namespace") {
+      if (i + 1 >= argc || !is_identifier(argv[i + 1])) {
+        cerr << format("Option {} requires an identifier\n", arg);
+        return opts;
+      }
+      (arg == "--name" ? opts.name : opts.name_space) = argv[++i];
+    } else {
+      positional.push_back(arg);
+    }
+  }
+
+  if (positional.empty() || positional.size() > 2) {
+    cerr << format("Usage: {} [--name NAME] [--namespace NS] "
+                   "[--no-prefix-skip] [-i] REGEX [OUTPUT]\n",
+                   argv[0]);
+    return opts;
+  }
+
+  opts.regex = string(positional[0]);
+  if (positional.size() == 2)
+    opts.output = string(positional[1]);
+  opts.valid = true;
+  return opts;
+}
+
+/* Octal escapes never run into a following digit the way \x escapes do */
+static string c_string(string_view bytes) {
+  string out = "\"";
+  for (unsigned char c : bytes) {
+    if (c == '"' || c == '\\')
+      out += format("\\{}", (char)c);
+    else if (isprint(c))
+      out += (char)c;
+    else
+      out += format("\\{:03o}", c);
+  }
+  return out + "\"";
+}
+
+static string emit_state(const DFA_View &dfa, int state) {
+  string out = format("  s{}:\n", state);
+  out += format("    if (p == end)\n      return {};\n",
+                dfa.accepts(state, CONTEXT_EDGE) ? "true" : "false");
+
+  // Classes grouped by target, dead transitions left to `default`
+  map<int, vector<int>> by_target;
+  for (int c = 0; c < dfa.class_count; c++) {
+    int t = dfa.transitions[state * dfa.class_count + c];
+    if (t >= 0)
+      by_target[t].push_back(c);
+  }
+
+  if (by_target.empty())
+    return out + "    return false;\n";
+  if (by_target.size() == 1 &&
+      by_target.begin()->second.size() == size_t(dfa.class_count))
+    return out + format("    p++;\n    goto s{};\n", by_target.begin()->first);
+
+  out += "    switch (byte_class[*p++]) {\n";
+  for (const auto &[target, classes] : by_target) {
+    for (int c : classes)
+      out += format("    case {}:\n", c);
+    out += format("      goto s{};\n", target);
+  }
+  out += "    default:\n      return false;\n    }\n";
+  return out;
+}
+
+static string generate(const Options &opts, const CompiledRegex &regex) {
+  const DFA_View &dfa = regex.table();
+  string prefix = opts.prefix_skip ? regex.literal_prefix() : "";
+
+  string guard;
+  for (char c : opts.name_space + "_" + opts.name)
+    guard += (char)toupper((unsigned char)c);
+  guard += "_HPP";
+
+  string out;
+  string comment = opts.regex;
+  for (char &c : comment)
+    if (c == '\n' || c == '\r')
+      c = ' ';
+  out += format("// Generated by fa_codegen from: {}\n", comment);
+  out += "// Do not edit; regenerate from the pattern instead.\n";
+  out += format("#ifndef {0}\n#define {0}\n\n", guard);
+  out += "#include <cstddef>\n#include <string_view>\n\n";
+  out += format("namespace {} {{\n\n", opts.name_space);
+  out += format("struct {} {{\n", opts.name);
+
+  out += "  static constexpr unsigned char byte_class[256] = {";
+  for (int b = 0; b < 256; b++) {
+    out += b % 16 ? " " : "\n      ";
+    out += format("{},", (int)dfa.byte_class[b]);
+  }
+  out += "\n  };\n\n";
+
+  out += format("  static constexpr std::string_view prefix = {};\n\n",
+                c_string(prefix));
+
+  // Whole-word match, as CompiledRegex::match()
+  out += "  static bool match(std::string_view text) {\n";
+  if (dfa.initial_state < 0) {
+    out += "    (void)text;\n    return false;\n  }\n\n";
+  } else {
+    int start = dfa.initial_state;
+    for (unsigned char c : prefix)
+      start = dfa.next(start, c);
+    out += "    if (!text.starts_with(prefix))\n      return false;\n";
+    out += "    const unsigned char *p =\n"
+           "        reinterpret_cast<const unsigned char *>(text.data()) +\n"
+           "        prefix.size();\n";
+    out += "    const unsigned char *end =\n"
+           "        reinterpret_cast<const unsigned char *>(text.data()) +\n"
+           "        text.size();\n";
+    out += format("    goto s{};\n\n", start);
+
+    // Only states reachable past the prefix get a label
+    vector<bool> reached(dfa.state_count, false);
+    vector<int> pending{start};
+    reached[start] = true;
+    while (!pending.empty()) {
+      int s = pending.back();
+      pending.pop_back();
+      for (int c = 0; c < dfa.class_count; c++) {
+        int t = dfa.transitions[s * dfa.class_count + c];
+        if (t >= 0 && !reached[t]) {
+          reached[t] = true;
+          pending.push_back(t);
+        }
+      }
+    }
+    for (int s = 0; s < dfa.state_count; s++)
+      if (reached[s])
+        out += emit_state(dfa, s);
+    out += "  }\n\n";
+  }
+
+  // Literal-prefix skip for callers scanning a line for match starts
+  out += "  // First position >= from where a match could start\n";
+  out += "  static size_t next_candidate(std::string_view text, size_t from) "
+         "{\n";
+  out += "    if (prefix.empty() || from >= text.size())\n"
+         "      return from < text.size() ? from : text.size();\n";
+  out += "    size_t pos = text.find(prefix, from);\n"
+         "    return pos == std::string_view::npos ? text.size() : pos;\n";
+  out += "  }\n";
+
+  out += "};\n\n";
+  out += format("}} // namespace {}\n\n#endif // !{}\n", opts.name_space,
+                guard);
+  return out;
+}
+
+int main(int argc, char *argv[]) {
+  Options opts = parse_args(argc, argv);
+  if (!opts.valid)
+    return 1;
+
+  try {
+    shared_ptr<const CompiledRegex> regex =
+        Parser(opts.regex).parse()->compile(opts.compile);
+    string header = generate(opts, *regex);
+
+    if (opts.output.empty()) {
+      cout << header;
+      return 0;
+    }
+    ofstream out(opts.output);
+    out << header;
+    out.close();
+    if (!out) {
+      cerr << format("Error: cannot write '{}'\n", opts.output);
+      return 1;
+    }
+  } catch (const exception &e) {
+    cerr << "Error: " << e.what() << '\n';
+    return 1;
+  }
+
+  return 0;
+}
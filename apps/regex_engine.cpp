@@ -17,18 +17,34 @@
  */
 
 #include "../include/fa/parser/parser.hpp"
+#include "../include/fa/regex/compiled.hpp"
+#include "../include/fa/regex/disk_cache.hpp"
+#include "../include/fa/regex/pattern_set.hpp"
 #include "../include/fa/regex/regex.hpp"
-#include <cctype>
+#include "../include/fa/regex/serialize.hpp"
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <filesystem>
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 
 using namespace std;
 using namespace fa::regex;
+namespace fs = std::filesystem;
 
 #define BOLD_RED "\033[1;31m"
 #define RESET "\033[0m"
@@ -40,7 +56,30 @@ static const vector<string> flags = {
     "-i    Ignore case distinctions.",
     "-w    Match only whole words.",
     "-x    Match only whole lines.",
-    "-h    Display this help text and exit."};
+    "-l    Print only the name of a file with a match.",
+    "-L    Print only the name of a file without a match.",
+    "-q    Print nothing; the exit status tells whether a line matched.",
+    "-m NUM  Stop reading after NUM selected lines.",
+    "-o    Print only the matched parts, one per line.",
+    "-b    Print the byte offset of each line (with -o, of each match).",
+    "-A NUM  Print NUM lines of context after each selected line.",
+    "-B NUM  Print NUM lines of context before each selected line.",
+    "-C NUM  Print NUM lines of context before and after.",
+    "-e PAT  Use PAT as a pattern; may be given more than once.",
+    "-f FILE Read patterns from FILE, one per line.",
+    "-h    Display this help text and exit.",
+    "--save-compiled FILE  Write the compiled automaton to FILE.",
+    "--load-compiled FILE  Use the automaton in FILE instead of a REGEX.",
+    "--no-cache            Do not read or write the compiled-pattern cache.",
+    "--color[=WHEN]        Highlight matches: auto (default), always or "
+    "never.",
+    "--and PAT             Also require a match of PAT on the line.",
+    "--not PAT             Reject lines with a match of PAT.",
+    "--batch QUERIES       Run every query in QUERIES over one read of FILE.",
+    "--pattern-ids         Prefix each line with the numbers of the "
+    "patterns it matches."};
+
+enum class Color { AUTO, ALWAYS, NEVER };
 
 struct Flags {
   bool count = false;        // -c
@@ -50,15 +89,56 @@ struct Flags {
   bool word_regexp = false;  // -w
   bool line_regexp = false;  // -x
   bool help = false;         // -h
+  bool no_cache = false;     // --no-cache
+  bool files_with_matches = false;  // -l
+  bool files_without_match = false; // -L
+  bool quiet = false;               // -q
+  long max_count = -1;              // -m NUM; -1 is no limit
+  bool only_matching = false;       // -o
+  bool byte_offset = false;         // -b
+  Color color = Color::AUTO;        // --color=WHEN
+  long after_context = 0;           // -A NUM
+  long before_context = 0;          // -B NUM
+  bool pattern_ids = false;         // --pattern-ids
 };
 
 struct Args {
   Flags flags;
-  string regex;
+  vector<string> patterns; // REGEX, or every -e and -f pattern in order
+  bool explicit_patterns = false; // -e or -f given; no REGEX operand
   string filepath;
+  string save_compiled; // --save-compiled FILE
+  string load_compiled; // --load-compiled FILE
+  string batch;         // --batch QUERIES
+  vector<string> and_patterns; // --and PAT
+  vector<string> not_patterns; // --not PAT
   bool valid = false;
 };
 
+/* As in grep, a pattern with newlines is one pattern per line */
+static void add_patterns(vector<string> &patterns, string_view text) {
+  while (true) {
+    size_t newline = text.find('\n');
+    patterns.emplace_back(text.substr(0, newline));
+    if (newline == string_view::npos)
+      return;
+    text.remove_prefix(newline + 1);
+  }
+}
+
+/* -f FILE: one pattern per line; an empty file adds none */
+static bool read_patterns(vector<string> &patterns, const string &path) {
+  ifstream in(path);
+  if (!in) {
+    cerr << format("Error: cannot open pattern file '{}'\n", path);
+    return false;
+  }
+  string line;
+  while (getline(in, line))
+    patterns.push_back(line);
+  return true;
+}
+
 static Args parse_args(int argc, char **argv) {
   Args args;
   vector<string_view> positional;
@@ -71,8 +151,63 @@ static Args parse_args(int argc, char **argv) {
       continue;
     }
 
+    if (arg == "--no-cache") {
+      args.flags.no_cache = true;
+      continue;
+    }
+
+    if (arg == "--pattern-ids") {
+      args.flags.pattern_ids = true;
+      continue;
+    }
+
+    if (arg.starts_with("--color") || arg.starts_with("--colour")) {
+      string_view when =
+          arg.substr(arg.starts_with("--colour") ? strlen("--colour")
+                                                 : strlen("--color"));
+      if (when.empty() || when == "=auto") {
+        args.flags.color = Color::AUTO;
+      } else if (when == "=always") {
+        args.flags.color = Color::ALWAYS;
+      } else if (when == "=never") {
+        args.flags.color = Color::NEVER;
+      } else {
+        cerr << format("Unknown option: {}\n", arg);
+        return args;
+      }
+      continue;
+    }
+
+    if (arg == "--and" || arg == "--not") {
+      if (i + 1 >= argc) {
+        cerr << format("Option {} requires a pattern\n", arg);
+        return args;
+      }
+      (arg == "--and" ? args.and_patterns : args.not_patterns)
+          .push_back(argv[++i]);
+      continue;
+    }
+
+    if (arg.starts_with("--")) {
+      string *target = arg == "--save-compiled"   ? &args.save_compiled
+                       : arg == "--load-compiled" ? &args.load_compiled
+                       : arg == "--batch"         ? &args.batch
+                                                  : nullptr;
+      if (!target) {
+        cerr << format("Unknown option: {}\n", arg);
+        return args;
+      }
+      if (i + 1 >= argc) {
+        cerr << format("Option {} requires a FILE argument\n", arg);
+        return args;
+      }
+      *target = argv[++i];
+      continue;
+    }
+
     if (arg[0] == '-') {
-      for (char c : arg.substr(1)) {
+      for (size_t j = 1; j < arg.size(); j++) {
+        char c = arg[j];
         switch (c) {
         case 'c':
           args.flags.count = true;
@@ -92,6 +227,65 @@ static Args parse_args(int argc, char **argv) {
         case 'x':
           args.flags.line_regexp = true;
           break;
+        case 'l':
+          args.flags.files_with_matches = true;
+          break;
+        case 'L':
+          args.flags.files_without_match = true;
+          break;
+        case 'q':
+          args.flags.quiet = true;
+          break;
+        case 'o':
+          args.flags.only_matching = true;
+          break;
+        case 'b':
+          args.flags.byte_offset = true;
+          break;
+        case 'm':
+        case 'A':
+        case 'B':
+        case 'C': {
+          /* -m NUM or -mNUM, and the same for the context options */
+          string_view value = arg.substr(j + 1);
+          if (value.empty() && i + 1 < argc)
+            value = argv[++i];
+          long number = -1;
+          auto [end, ec] =
+              from_chars(value.data(), value.data() + value.size(), number);
+          if (value.empty() || ec != errc() ||
+              end != value.data() + value.size() || number < 0) {
+            cerr << format("Invalid argument for -{}: '{}'\n", c, value);
+            return args;
+          }
+          if (c == 'm')
+            args.flags.max_count = number;
+          if (c == 'A' || c == 'C')
+            args.flags.after_context = number;
+          if (c == 'B' || c == 'C')
+            args.flags.before_context = number;
+          j = arg.size();
+          break;
+        }
+        case 'e':
+        case 'f': {
+          /* -e PAT or -ePAT, -f FILE or -fFILE */
+          string_view value = arg.substr(j + 1);
+          if (value.empty()) {
+            if (i + 1 >= argc) {
+              cerr << format("Option -{} requires an argument\n", c);
+              return args;
+            }
+            value = argv[++i];
+          }
+          if (c == 'e')
+            add_patterns(args.patterns, value);
+          else if (!read_patterns(args.patterns, string(value)))
+            return args;
+          args.explicit_patterns = true;
+          j = arg.size();
+          break;
+        }
         case 'h':
           args.flags.help = true;
           return args;
@@ -105,84 +299,426 @@ static Args parse_args(int argc, char **argv) {
     }
   }
 
-  if (positional.size() != 2) {
+  if (args.explicit_patterns && !args.load_compiled.empty()) {
+    cerr << "Error: -e and -f cannot be used with --load-compiled\n";
+    return args;
+  }
+
+  bool boolean_query =
+      !args.and_patterns.empty() || !args.not_patterns.empty();
+  if (boolean_query && !args.save_compiled.empty()) {
+    cerr << "Error: --and and --not cannot be used with --save-compiled\n";
+    return args;
+  }
+  if (!args.batch.empty() &&
+      (args.explicit_patterns || !args.load_compiled.empty() ||
+       !args.save_compiled.empty() || boolean_query)) {
+    cerr << "Error: --batch takes its patterns from the query file\n";
+    return args;
+  }
+
+  /* With --load-compiled the automaton replaces REGEX, and so do -e, -f
+     and --batch; with --save-compiled FILE may be left out to only
+     compile */
+  size_t wanted = args.load_compiled.empty() && !args.explicit_patterns &&
+                          args.batch.empty()
+                      ? 2
+                      : 1;
+  bool only_save = !args.save_compiled.empty() && args.load_compiled.empty() &&
+                   positional.size() == wanted - 1;
+  if (positional.size() != wanted && !only_save) {
     cerr << format("Usage: {} [OPTION]... REGEX [FILE]...\n", argv[0]);
     cerr << format("Try: '{} -h' for more information\n", argv[0]);
     return args;
   }
 
-  args.regex = string(positional[0]); // copia a string, seguro
-  args.filepath = string(positional[1]);
+  if (wanted == 2)
+    add_patterns(args.patterns, positional[0]);
+  if (!only_save)
+    args.filepath = string(positional.back());
   args.valid = true;
   return args;
 }
 
-static string to_lower(string_view s) {
-  string result(s);
-  for (char &c : result)
-    c = tolower((unsigned char)c);
-  return result;
+/* The input one line at a time. A regular file is mapped and every line
+   is a view into the mapping. Anything else (pipes, FIFOs, /dev/stdin) is
+   read CHUNK bytes at a time; the unfinished last line of a chunk is
+   carried over to the next, so a search that stops early never waits for
+   the end of the stream, and memory stays at a chunk plus the longest
+   line. Bytes from the offset given to retain() on are kept as well, for
+   text() to return; anything before it may be dropped by the next read. */
+class LineReader {
+public:
+  static constexpr size_t CHUNK = 65536;
+
+  struct Line {
+    string_view text; // valid until the next call to next()
+    size_t offset = 0; // of its first byte in the input
+  };
+
+  explicit LineReader(const string &path) {
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw runtime_error(format("cannot open '{}'", path));
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        mapped = static_cast<const char *>(addr);
+        size = st.st_size;
+        eof = true;
+        madvise(addr, size, MADV_SEQUENTIAL);
+      }
+    }
+  }
+
+  LineReader(const LineReader &) = delete;
+  LineReader &operator=(const LineReader &) = delete;
+
+  ~LineReader() {
+    if (mapped)
+      munmap(const_cast<char *>(mapped), size);
+    close(fd);
+  }
+
+  bool next(Line &line) {
+    while (true) {
+      const char *data = this->data();
+      const void *newline = memchr(data + scan, '\n', size - scan);
+      if (newline || (eof && pos < size)) {
+        size_t end = newline ? static_cast<const char *>(newline) - data
+                             : size;
+        line = {string_view(data + pos, end - pos), base + pos};
+        pos = scan = min(end + 1, size);
+        return true;
+      }
+      if (eof)
+        return false;
+      scan = size;
+      fill();
+    }
+  }
+
+  // Keeps the bytes from input offset `offset` on readable through text()
+  void retain(size_t offset) { keep = offset; }
+  void release() { keep = SIZE_MAX; }
+
+  // `length` bytes at input offset `offset`, which has to be retained or
+  // belong to the line last returned
+  string_view text(size_t offset, size_t length) const {
+    return string_view(data() + (offset - base), length);
+  }
+
+private:
+  const char *data() const { return mapped ? mapped : buffer.data(); }
+
+  /* Drops what is neither retained nor still to be returned and reads
+     the next chunk after the rest */
+  void fill() {
+    size_t drop = keep > base ? min(pos, keep - base) : 0;
+    buffer.erase(0, drop);
+    base += drop;
+    pos -= drop;
+    scan -= drop;
+
+    ssize_t n;
+    buffer.resize_and_overwrite(size + CHUNK - drop,
+                                [&](char *p, size_t) {
+                                  size_t used = size - drop;
+                                  do
+                                    n = read(fd, p + used, CHUNK);
+                                  while (n < 0 && errno == EINTR);
+                                  return used + (n > 0 ? n : 0);
+                                });
+    if (n < 0)
+      throw runtime_error(format("read error: {}", strerror(errno)));
+    size = buffer.size();
+    eof = n == 0;
+  }
+
+  int fd = -1;
+  const char *mapped = nullptr;
+  string buffer;        // streamed input from `base` on
+  size_t size = 0;      // bytes in the mapping or the buffer
+  size_t base = 0;      // input offset of buffer[0]
+  size_t pos = 0;       // where the next line starts
+  size_t scan = 0;      // no newline in [pos, scan)
+  size_t keep = SIZE_MAX;
+  bool eof = false;
+};
+
+/* Copies `line` into `out` with every span wrapped in color codes */
+static void append_highlighted(string &out, string_view line,
+                               const vector<MatchSpan> &spans) {
+  size_t pos = 0;
+  for (const MatchSpan &span : spans) {
+    out.append(line.substr(pos, span.start - pos));
+    out += BOLD_RED;
+    out.append(line.substr(span.start, span.length));
+    out += RESET;
+    pos = span.start + span.length;
+  }
+  out.append(line.substr(pos));
+}
+
+/* "N: " before a selected line and "N- " before a context line, as grep
+   uses ':' and '-' */
+static void append_prefix(string &out, const Flags &flags, int line_num,
+                          size_t offset, char separator) {
+  if (flags.line_number)
+    out += format("{}{} ", line_num, separator);
+  if (flags.byte_offset)
+    out += format("{}{} ", offset, separator);
+}
+
+/* Whole-line run of a --and/--not query automaton */
+static bool accepts_line(const DFA_Fast &dfa, string_view line) {
+  int curr = dfa.initial_state;
+  for (unsigned char symbol : line) {
+    if (curr < 0)
+      return false;
+    curr = dfa.next(curr, symbol);
+  }
+  return curr >= 0 && dfa.accepts(curr, CONTEXT_EDGE);
+}
+
+/* --color=auto highlights only for a terminal that can show it */
+static bool use_color(Color when) {
+  if (when != Color::AUTO)
+    return when == Color::ALWAYS;
+  const char *term = getenv("TERM");
+  return isatty(STDOUT_FILENO) && term && string_view(term) != "dumb";
 }
 
-static bool at_word_boundary(string_view line, size_t start, size_t len) {
-  bool left_ok = (start == 0) || !isalnum((unsigned char)line[start - 1]);
-  bool right_ok = (start + len >= line.size()) ||
-                  !isalnum((unsigned char)line[start + len]);
-  return left_ok && right_ok;
+static CompileOptions compile_options(const Flags &flags) {
+  CompileOptions options;
+  options.ignore_case = flags.ignore_case;
+  options.word_regexp = flags.word_regexp;
+  options.line_regexp = flags.line_regexp;
+  return options;
+}
+
+/* Several patterns become one automaton whose states know which of them
+   matched, or a few if their union would be too large; an empty one
+   matches every line, as in grep */
+static shared_ptr<const PatternSet>
+compile_patterns(const vector<string> &patterns,
+                 const CompileOptions &options) {
+  if (patterns.size() == 1)
+    return make_shared<const PatternSet>(
+        Parser(patterns[0]).parse()->compile(options));
+
+  vector<shared_ptr<Regex>> trees;
+  for (const string &pattern : patterns)
+    trees.push_back(pattern.empty() ? make_shared<Lambda>()
+                                    : Parser(pattern).parse());
+  return make_shared<const PatternSet>(trees, options);
+}
+
+/* Compiles through the cache directory: a hit maps the stored automaton, a
+   miss compiles and stores it. A set split into shards is stored one entry
+   per shard, under the set's key followed by the shard's index, and is a
+   hit only when shards covering every pattern are found. The cache is only
+   an accelerator, so failing to write it is not an error. */
+static shared_ptr<const PatternSet>
+compile_cached(const vector<string> &patterns, const Flags &flags) {
+  CompileOptions options = compile_options(flags);
+
+  fs::path dir = flags.no_cache ? fs::path() : DiskCache::default_dir();
+  if (dir.empty())
+    return compile_patterns(patterns, options);
+
+  /* Patterns never contain a newline, so joining them is unambiguous */
+  string joined;
+  for (size_t i = 0; i < patterns.size(); i++)
+    joined += (i ? "\n" : "") + patterns[i];
+
+  DiskCache cache(dir);
+  string key = DiskCache::make_key(joined, options.letters());
+  auto shard_key = [&](size_t i) { return format("{}\nshard {}", key, i); };
+  if (auto hit = cache.load(key))
+    return make_shared<const PatternSet>(hit);
+
+  vector<shared_ptr<const CompiledRegex>> shards;
+  size_t covered = 0;
+  while (covered < patterns.size()) {
+    shared_ptr<const CompiledRegex> shard = cache.load(shard_key(shards.size()));
+    if (!shard || shard->pattern_count() == 0)
+      break;
+    covered += shard->pattern_count();
+    shards.push_back(move(shard));
+  }
+  if (!shards.empty() && covered == patterns.size())
+    return make_shared<const PatternSet>(move(shards));
+
+  shared_ptr<const PatternSet> engine = compile_patterns(patterns, options);
+  try {
+    if (engine->shard_count() == 1)
+      cache.store(key, engine->shard(0));
+    else
+      for (size_t i = 0; i < engine->shard_count(); i++)
+        cache.store(shard_key(i), engine->shard(i));
+  } catch (const exception &) {
+    // Read-only or full cache directory: search with the fresh automaton
+  }
+  return engine;
 }
 
-static string process_line(string_view line, const shared_ptr<Regex> &engine,
-                           const Flags &flags, bool &has_match) {
+/* One line of a --batch query file: "OUTPUT FLAGS PATTERN", where OUTPUT
+   is a file or "-" for stdout, FLAGS is "-" or letters such as "-ci", and
+   the rest of the line is the pattern */
+struct Output {
+  unique_ptr<ofstream> file; // null for stdout
+  string buffer;
+
+  ostream &stream() { return file ? *file : cout; }
+};
+
+struct Query {
   string output;
-  size_t pos = 0;
-  has_match = false;
-
-  if (flags.line_regexp) {
-    string_view test_view = line;
-    string test_str;
-    if (flags.ignore_case) {
-      test_str = to_lower(line);
-      test_view = test_str;
+  Flags flags;
+  string pattern;
+  shared_ptr<const PatternSet> engine; // null for an empty pattern
+  Output *out = nullptr;
+  long match_count = 0;
+};
+
+static vector<Query> read_queries(const string &path) {
+  ifstream in(path);
+  if (!in)
+    throw runtime_error(format("cannot open query file '{}'", path));
+
+  vector<Query> queries;
+  string line;
+  for (int line_num = 1; getline(in, line); line_num++) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    size_t flags_start = line.find(' ');
+    size_t pattern_start =
+        flags_start == string::npos ? string::npos : line.find(' ', flags_start + 1);
+    if (pattern_start == string::npos || line[flags_start + 1] != '-')
+      throw runtime_error(format("{}:{}: expected 'OUTPUT FLAGS PATTERN'",
+                                 path, line_num));
+
+    Query query;
+    query.output = line.substr(0, flags_start);
+    query.pattern = line.substr(pattern_start + 1);
+    for (size_t j = flags_start + 2; j < pattern_start; j++) {
+      switch (line[j]) {
+      case 'c':
+        query.flags.count = true;
+        break;
+      case 'v':
+        query.flags.invert_match = true;
+        break;
+      case 'n':
+        query.flags.line_number = true;
+        break;
+      case 'i':
+        query.flags.ignore_case = true;
+        break;
+      case 'w':
+        query.flags.word_regexp = true;
+        break;
+      case 'x':
+        query.flags.line_regexp = true;
+        break;
+      case 'o':
+        query.flags.only_matching = true;
+        break;
+      case 'b':
+        query.flags.byte_offset = true;
+        break;
+      default:
+        throw runtime_error(
+            format("{}:{}: unsupported flag -{}", path, line_num, line[j]));
+      }
     }
-    if (engine->match(test_view)) {
-      has_match = true;
-      return string(BOLD_RED) + string(line) + RESET;
+    queries.push_back(move(query));
+  }
+  return queries;
+}
+
+/* --batch: every query is compiled up front and the input is read once,
+   through the same LineReader as a single search, so a pipe is streamed
+   rather than held in memory. Each line is handed to every query in
+   turn, and each query writes its lines or its count to its own output.
+   Queries naming the same output share its buffer, so their lines
+   interleave in input order and their counts follow at the end. */
+static int run_batch(const Args &args) {
+  vector<Query> queries = read_queries(args.batch);
+
+  map<string, Output> outputs;
+  for (Query &query : queries) {
+    if (!query.pattern.empty())
+      query.engine = compile_cached({query.pattern}, query.flags);
+    auto [it, inserted] = outputs.try_emplace(query.output);
+    if (inserted && query.output != "-") {
+      it->second.file = make_unique<ofstream>(query.output, ios::trunc);
+      if (!*it->second.file)
+        throw runtime_error(format("cannot write '{}'", query.output));
     }
-    return string(line);
+    query.out = &it->second;
   }
 
-  while (pos < line.size()) {
-    int longest = -1;
-    string_view remaining = line.substr(pos);
-    string lower_remaining;
-    if (flags.ignore_case)
-      lower_remaining = to_lower(remaining);
-
-    for (size_t len = 1; len <= remaining.size(); ++len) {
-      string_view candidate = flags.ignore_case
-                                  ? string_view(lower_remaining).substr(0, len)
-                                  : remaining.substr(0, len);
-
-      if (engine->match(candidate)) {
-        if (!flags.word_regexp || at_word_boundary(line, pos, len))
-          longest = len;
-      } else if (longest != -1) {
-        break;
+  LineReader reader(args.filepath);
+  vector<MatchSpan> spans;
+  int line_num = 0;
+
+  LineReader::Line current;
+  while (reader.next(current)) {
+    string_view line = current.text;
+    size_t line_start = current.offset;
+    line_num++;
+
+    for (Query &query : queries) {
+      const Flags &f = query.flags;
+      string &buffer = query.out->buffer;
+      bool has_match = !query.engine || query.engine->contains(line);
+      if (has_match == f.invert_match)
+        continue;
+      query.match_count++;
+      if (f.count)
+        continue;
+
+      if (f.only_matching) {
+        if (f.invert_match || !query.engine)
+          continue;
+        query.engine->find_all(line, spans);
+        for (const MatchSpan &span : spans) {
+          append_prefix(buffer, f, line_num, line_start + span.start, ':');
+          buffer.append(line.substr(span.start, span.length));
+          buffer += '\n';
+        }
+      } else {
+        append_prefix(buffer, f, line_num, line_start, ':');
+        buffer.append(line);
+        buffer += '\n';
       }
-    }
 
-    if (longest != -1) {
-      output += BOLD_RED;
-      output.append(line.data() + pos, longest);
-      output += RESET;
-      pos += longest;
-      has_match = true;
-    } else {
-      output += line[pos++];
+      if (buffer.size() > 32768) {
+        query.out->stream() << buffer;
+        buffer.clear();
+      }
     }
   }
 
-  return output;
+  bool selected = false;
+  for (Query &query : queries) {
+    if (query.flags.count)
+      query.out->buffer += to_string(query.match_count) + '\n';
+    selected = selected || query.match_count > 0;
+  }
+  for (auto &[path, output] : outputs) {
+    output.stream() << output.buffer;
+    if (output.file) {
+      output.file->close();
+      if (!*output.file)
+        throw runtime_error(format("cannot write '{}'", path));
+    }
+  }
+  return selected ? 0 : 1;
 }
 
 static void help_handle() {
@@ -203,52 +739,214 @@ int main(int argc, char *argv[]) {
   if (!args.valid) {
     if (args.flags.help) {
       help_handle();
+      return 0;
     }
-    return 1;
+    return 2;
   }
 
   try {
-    bool empty_regex = args.regex.empty();
-
-    shared_ptr<Regex> engine;
+    if (!args.batch.empty())
+      return run_batch(args);
+
+    bool empty_regex = args.load_compiled.empty() &&
+                       args.patterns.size() == 1 && args.patterns[0].empty();
+
+    shared_ptr<const PatternSet> engine;
+
+    if (!args.load_compiled.empty()) {
+      shared_ptr<const CompiledRegex> loaded = load_compiled(args.load_compiled);
+      engine = make_shared<const PatternSet>(loaded);
+      /* -i, -w and -x are part of the stored automaton */
+      string stored = loaded->options().letters();
+      string wanted = compile_options(args.flags).letters();
+      if (stored != wanted) {
+        cerr << format("Error: '{}' was compiled with {}, not {}\n",
+                       args.load_compiled,
+                       stored.empty() ? "no flags" : "-" + stored,
+                       wanted.empty() ? "no flags" : "-" + wanted);
+        return 2;
+      }
+    } else if (!empty_regex) {
+      engine = compile_cached(args.patterns, args.flags);
+    }
 
-    if (!empty_regex) {
-      Parser parser(args.regex);
-      engine = parser.parse();
+    if (!args.save_compiled.empty()) {
+      if (!engine) {
+        cerr << "Error: an empty REGEX has no automaton to save\n";
+        return 2;
+      }
+      if (engine->shard_count() != 1) {
+        cerr << format("Error: the patterns need {} automata; only one can "
+                       "be saved\n",
+                       engine->shard_count());
+        return 2;
+      }
+      save_compiled(engine->shard(0), args.save_compiled);
+      if (args.filepath.empty())
+        return 0;
     }
 
-    ifstream file(args.filepath);
-    if (!file.is_open()) {
-      cerr << format("Error: cannot open '{}'\n", args.filepath);
-      return 1;
+    /* --and and --not make the query one whole-line automaton: the product
+       of "contains a match" automata, the --not ones complemented, so a
+       line is still read once. Spans and pattern ids come from the main
+       patterns alone. */
+    optional<DFA_Fast> query;
+    auto containing = [&](const PatternSet &set) {
+      if (set.shard_count() != 1)
+        throw runtime_error("--and and --not need patterns that fit in one "
+                            "automaton");
+      const DFA_View *search = set.shard(0).search_table();
+      if (!search)
+        throw runtime_error("--and and --not need patterns whose search "
+                            "automaton fits the state budget");
+      return DFA_Fast::from_view(*search).containing();
+    };
+    auto combine = [&](DFA_Fast part) {
+      query = query ? query->intersect(part) : move(part);
+    };
+    if (!args.and_patterns.empty() || !args.not_patterns.empty()) {
+      if (engine)
+        combine(containing(*engine));
+      for (const string &pattern : args.and_patterns)
+        if (!pattern.empty()) // matches every line
+          combine(containing(*compile_cached({pattern}, args.flags)));
+      for (const string &pattern : args.not_patterns)
+        combine(pattern.empty()
+                    ? DFA_Fast() // rejects every line
+                    : containing(*compile_cached({pattern}, args.flags))
+                          .complement());
     }
 
-    string line, global_buffer;
+    LineReader reader(args.filepath);
+
+    /* Only highlighted lines and -o need match spans; every other line
+       costs one boolean pass over the search DFA and is copied straight
+       from the input, and the non-printing modes stop as soon as the
+       answer is known */
+    const Flags &f = args.flags;
+    bool list_files = f.files_with_matches || f.files_without_match;
+    bool print_lines = !f.count && !list_files && !f.quiet;
+    bool color = use_color(f.color);
+    bool need_spans = print_lines && !f.invert_match && !empty_regex &&
+                      (color || f.only_matching);
+    /* Rule numbers come from a second pass over the line that does not
+       stop at the first match */
+    bool show_ids = print_lines && f.pattern_ids && !f.invert_match &&
+                    !f.only_matching && !empty_regex;
+    vector<uint32_t> ids;
+    long limit = f.max_count;
+    if (list_files || f.quiet)
+      limit = limit < 0 ? 1 : min(limit, 1L);
+
+    /* Context lines are never copied or re-scanned: before-context is a
+       ring of the spans of the last -B lines not printed, whose bytes the
+       reader keeps (a streamed input holds on to no more than that), and
+       after-context is a count of lines still owed. Groups that touch or
+       overlap merge; others are split by "--". -o prints no context. */
+    struct ContextLine {
+      size_t offset;
+      size_t length;
+      int number;
+    };
+    bool with_context = print_lines && !f.only_matching &&
+                        (f.after_context > 0 || f.before_context > 0);
+    deque<ContextLine> before_ring;
+    size_t printed_upto = 0; // offset just past the last printed line
+    bool printed_any = false;
+    long after_left = 0;
+
+    string global_buffer;
     global_buffer.reserve(65536);
-    int match_count = 0, line_num = 0;
-
-    while (getline(file, line)) {
+    vector<MatchSpan> spans;
+    long match_count = 0;
+    int line_num = 0;
+
+    auto emit_context = [&](size_t start, size_t length, int number) {
+      append_prefix(global_buffer, f, number, start, '-');
+      global_buffer.append(reader.text(start, length));
+      global_buffer += '\n';
+      printed_upto = start + length + 1;
+    };
+
+    LineReader::Line current;
+    while (reader.next(current)) {
+      string_view line = current.text;
+      size_t line_start = current.offset;
       line_num++;
-      bool has_match = false;
-      string output;
 
-      if (empty_regex) {
-        has_match = true;
-        output = line;
-      } else {
-        output = process_line(line, engine, args.flags, has_match);
+      /* After the last line -m allows, grep still prints the trailing
+         context, selected lines included */
+      if (limit >= 0 && match_count >= limit) {
+        if (after_left == 0)
+          break;
+        emit_context(line_start, line.size(), line_num);
+        after_left--;
+        continue;
       }
 
-      bool print = args.flags.invert_match ? !has_match : has_match;
+      bool has_match = query          ? accepts_line(*query, line)
+                       : empty_regex ? true
+                                     : engine->contains(line);
+      if (has_match == f.invert_match) {
+        if (with_context && after_left > 0) {
+          emit_context(line_start, line.size(), line_num);
+          after_left--;
+        } else if (with_context && f.before_context > 0) {
+          before_ring.push_back({line_start, line.size(), line_num});
+          if (before_ring.size() > size_t(f.before_context))
+            before_ring.pop_front();
+          reader.retain(before_ring.front().offset);
+        }
+        continue;
+      }
+
+      match_count++;
+      if (!print_lines)
+        continue;
+
+      if (with_context) {
+        size_t first = before_ring.empty() ? line_start
+                                           : before_ring.front().offset;
+        if (printed_any && first != printed_upto)
+          global_buffer += "--\n";
+        for (const ContextLine &before : before_ring)
+          emit_context(before.offset, before.length, before.number);
+        before_ring.clear();
+        reader.release();
+        printed_upto = line_start + line.size() + 1;
+        printed_any = true;
+        after_left = f.after_context;
+      }
 
-      if (print) {
-        match_count++;
-        if (!args.flags.count) {
-          if (args.flags.line_number)
-            global_buffer += to_string(line_num) + ": ";
-          global_buffer += args.flags.invert_match ? line : output;
+      spans.clear();
+      if (need_spans)
+        engine->find_all(line, spans);
+
+      if (f.only_matching) {
+        /* Spans go straight from the input to the output buffer */
+        for (const MatchSpan &span : spans) {
+          append_prefix(global_buffer, f, line_num, line_start + span.start,
+                        ':');
+          if (color)
+            global_buffer += BOLD_RED;
+          global_buffer.append(line.substr(span.start, span.length));
+          if (color)
+            global_buffer += RESET;
           global_buffer += '\n';
         }
+      } else {
+        append_prefix(global_buffer, f, line_num, line_start, ':');
+        if (show_ids) {
+          engine->matching_patterns(line, ids);
+          for (size_t k = 0; k < ids.size(); k++)
+            global_buffer += format("{}{}", k ? "," : "", ids[k] + 1);
+          global_buffer += ": ";
+        }
+        if (need_spans)
+          append_highlighted(global_buffer, line, spans);
+        else
+          global_buffer.append(line);
+        global_buffer += '\n';
       }
 
       if (global_buffer.size() > 32768) {
@@ -257,15 +955,22 @@ int main(int argc, char *argv[]) {
       }
     }
 
-    if (args.flags.count)
+    /* grep's exit status: 0 if something was selected, 1 if not; -L too,
+       as in GNU grep 3.5 and later */
+    bool selected = match_count > 0;
+    if (f.quiet)
+      return selected ? 0 : 1;
+    if (f.files_with_matches && selected)
+      global_buffer += args.filepath + '\n';
+    else if (f.files_without_match && !selected)
+      global_buffer += args.filepath + '\n';
+    else if (f.count && !list_files)
       global_buffer += to_string(match_count) + '\n';
 
     cout << global_buffer;
-
+    return selected ? 0 : 1;
   } catch (const exception &e) {
     cerr << "Error: " << e.what() << '\n';
-    return 1;
+    return 2;
   }
-
-  return 0;
 }
@@ -0,0 +1,144 @@
+// Generated by fa_codegen from: err|warn|warning
+// Do not edit; regenerate from the pattern instead.
+#ifndef FA_GENERATED_FOLDED_SEVERITY_HPP
+#define FA_GENERATED_FOLDED_SEVERITY_HPP
+
+#include <cstddef>
+#include <string_view>
+
+namespace fa_generated {
+
+struct folded_severity {
+  static constexpr unsigned char byte_class[256] = {
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 0, 7, 7, 7, 1, 7, 2, 7, 3, 7, 7, 7, 7, 4, 7,
+      7, 7, 5, 7, 7, 7, 7, 6, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 0, 7, 7, 7, 1, 7, 2, 7, 3, 7, 7, 7, 7, 4, 7,
+      7, 7, 5, 7, 7, 7, 7, 6, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+  };
+
+  static constexpr std::string_view prefix = "";
+
+  static bool match(std::string_view text) {
+    if (!text.starts_with(prefix))
+      return false;
+    const unsigned char *p =
+        reinterpret_cast<const unsigned char *>(text.data()) +
+        prefix.size();
+    const unsigned char *end =
+        reinterpret_cast<const unsigned char *>(text.data()) +
+        text.size();
+    goto s0;
+
+  s0:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 1:
+      goto s1;
+    case 6:
+      goto s2;
+    default:
+      return false;
+    }
+  s1:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 5:
+      goto s3;
+    default:
+      return false;
+    }
+  s2:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 0:
+      goto s4;
+    default:
+      return false;
+    }
+  s3:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 5:
+      goto s5;
+    default:
+      return false;
+    }
+  s4:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 5:
+      goto s6;
+    default:
+      return false;
+    }
+  s5:
+    if (p == end)
+      return true;
+    return false;
+  s6:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 4:
+      goto s7;
+    default:
+      return false;
+    }
+  s7:
+    if (p == end)
+      return true;
+    switch (byte_class[*p++]) {
+    case 3:
+      goto s8;
+    default:
+      return false;
+    }
+  s8:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 4:
+      goto s9;
+    default:
+      return false;
+    }
+  s9:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 2:
+      goto s5;
+    default:
+      return false;
+    }
+  }
+
+  // First position >= from where a match could start
+  static size_t next_candidate(std::string_view text, size_t from) {
+    if (prefix.empty() || from >= text.size())
+      return from < text.size() ? from : text.size();
+    size_t pos = text.find(prefix, from);
+    return pos == std::string_view::npos ? text.size() : pos;
+  }
+};
+
+} // namespace fa_generated
+
+#endif // !FA_GENERATED_FOLDED_SEVERITY_HPP
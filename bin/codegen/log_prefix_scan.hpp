@@ -0,0 +1,120 @@
+// Generated by fa_codegen from: ERR: [0-9]+
+// Do not edit; regenerate from the pattern instead.
+#ifndef FA_GENERATED_LOG_PREFIX_SCAN_HPP
+#define FA_GENERATED_LOG_PREFIX_SCAN_HPP
+
+#include <cstddef>
+#include <string_view>
+
+namespace fa_generated {
+
+struct log_prefix_scan {
+  static constexpr unsigned char byte_class[256] = {
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      0, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 3, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+  };
+
+  static constexpr std::string_view prefix = "";
+
+  static bool match(std::string_view text) {
+    if (!text.starts_with(prefix))
+      return false;
+    const unsigned char *p =
+        reinterpret_cast<const unsigned char *>(text.data()) +
+        prefix.size();
+    const unsigned char *end =
+        reinterpret_cast<const unsigned char *>(text.data()) +
+        text.size();
+    goto s0;
+
+  s0:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 3:
+      goto s1;
+    default:
+      return false;
+    }
+  s1:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 4:
+      goto s2;
+    default:
+      return false;
+    }
+  s2:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 4:
+      goto s3;
+    default:
+      return false;
+    }
+  s3:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 2:
+      goto s4;
+    default:
+      return false;
+    }
+  s4:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 0:
+      goto s5;
+    default:
+      return false;
+    }
+  s5:
+    if (p == end)
+      return false;
+    switch (byte_class[*p++]) {
+    case 1:
+      goto s6;
+    default:
+      return false;
+    }
+  s6:
+    if (p == end)
+      return true;
+    switch (byte_class[*p++]) {
+    case 1:
+      goto s6;
+    default:
+      return false;
+    }
+  }
+
+  // First position >= from where a match could start
+  static size_t next_candidate(std::string_view text, size_t from) {
+    if (prefix.empty() || from >= text.size())
+      return from < text.size() ? from : text.size();
+    size_t pos = text.find(prefix, from);
+    return pos == std::string_view::npos ? text.size() : pos;
+  }
+};
+
+} // namespace fa_generated
+
+#endif // !FA_GENERATED_LOG_PREFIX_SCAN_HPP
@@ -0,0 +1,75 @@
+#ifndef BYTE_CLASSES_HPP
+#define BYTE_CLASSES_HPP
+
+#include <array>
+#include <bitset>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Partition of the byte alphabet into equivalence classes. Two bytes share a
+// class when every edge label refined so far contains both or neither of
+// them, so an automaton only has to be explored once per class.
+class ByteClasses {
+private:
+  std::array<int, 256> class_of;            // -1: no edge reads the byte
+  std::vector<std::vector<char>> class_members;
+
+public:
+  ByteClasses() { class_of.fill(-1); }
+
+  void refine(const std::bitset<256> &label) {
+    std::map<std::pair<int, bool>, int> split;
+    std::array<int, 256> refined;
+    for (int b = 0; b < 256; b++) {
+      bool in = label.test(b);
+      if (class_of[b] < 0 && !in) {
+        refined[b] = -1;
+        continue;
+      }
+      auto key = std::make_pair(class_of[b], in);
+      auto it = split.find(key);
+      if (it == split.end())
+        it = split.emplace(key, static_cast<int>(split.size())).first;
+      refined[b] = it->second;
+    }
+
+    // Renumber by first member so ids follow byte order
+    std::vector<int> renumber(split.size(), -1);
+    int next = 0;
+    for (int b = 0; b < 256; b++)
+      if (refined[b] >= 0 && renumber[refined[b]] < 0)
+        renumber[refined[b]] = next++;
+
+    class_members.assign(next, {});
+    for (int b = 0; b < 256; b++) {
+      class_of[b] = refined[b] < 0 ? -1 : renumber[refined[b]];
+      if (class_of[b] >= 0)
+        class_members[class_of[b]].push_back(static_cast<char>(b));
+    }
+  }
+
+  void refine(char symbol) {
+    std::bitset<256> label;
+    label.set(static_cast<unsigned char>(symbol));
+    refine(label);
+  }
+
+  [[nodiscard]] int count() const {
+    return static_cast<int>(class_members.size());
+  }
+
+  [[nodiscard]] int class_of_byte(unsigned char b) const {
+    return class_of[b];
+  }
+
+  [[nodiscard]] const std::vector<char> &members(int cls) const {
+    return class_members[cls];
+  }
+
+  [[nodiscard]] char representative(int cls) const {
+    return class_members[cls].front();
+  }
+};
+
+#endif // !BYTE_CLASSES_HPP
@@ -1,13 +1,22 @@
 #ifndef DFA_HPP
 #define DFA_HPP
 
+#include "byte_classes.hpp"
 #include "fa.hpp"
 #include <memory>
 #include <string>
 class DFA : public FA<std::string> {
+protected:
+  // Set by NDFA::determinize. Every byte of a class must have the same
+  // target in every state; when unset each alphabet symbol is its own class.
+  ByteClasses classes;
+
 public:
   DFA() : FA<std::string>() {}
 
+  void set_byte_classes(const ByteClasses &byte_classes);
+  [[nodiscard]] ByteClasses byte_classes() const;
+
   std::unique_ptr<DFA> minimize(void);
 };
 
@@ -0,0 +1,184 @@
+#ifndef DFA_FAST_HPP
+#define DFA_FAST_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// What lies next to a position, as far as zero-width assertions care. EDGE
+// is the start of the text when looking back and its end when looking ahead.
+enum Context : uint8_t {
+  CONTEXT_EDGE = 0,
+  CONTEXT_WORD = 1,
+  CONTEXT_NON_WORD = 2
+};
+
+// Word bytes for /b, /B and -w: ASCII letters and digits
+constexpr bool is_word_byte(unsigned char c) {
+  return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
+         (c >= 'a' && c <= 'z');
+}
+
+constexpr Context context_of(unsigned char c) {
+  return is_word_byte(c) ? CONTEXT_WORD : CONTEXT_NON_WORD;
+}
+
+// accept_states holds one bit per context that may follow the match; a
+// pattern without assertions accepts before anything (ACCEPT_ALWAYS)
+constexpr uint8_t accept_bit(Context next) { return uint8_t(1u << next); }
+inline constexpr uint8_t ACCEPT_ALWAYS = 0b111;
+
+// An automaton compiled from a set of patterns also lists, per state, the
+// patterns a match ending there belongs to: one entry per pattern, its id
+// shifted over the accept_bit() mask it has in that state
+constexpr uint32_t pattern_entry(uint32_t id, uint8_t accept) {
+  return id << 3 | accept;
+}
+constexpr uint32_t entry_pattern(uint32_t entry) { return entry >> 3; }
+constexpr bool entry_accepts(uint32_t entry, Context next) {
+  return entry & accept_bit(next);
+}
+
+// Read-only view of a flat table. The arrays may belong to a DFA_Fast or to
+// a compiled automaton mapped straight from disk.
+struct DFA_View {
+  int initial_state = -1;
+  int initial_after_word = -1;
+  int initial_after_non_word = -1;
+  int class_count = 0;
+  int state_count = 0;
+  const uint8_t *byte_class = nullptr; // 256 entries
+  const int *transitions = nullptr;    // state * class_count + class
+  const uint8_t *accept_states = nullptr;
+  // Both null unless compiled from a pattern set; state s owns the entries
+  // from pattern_offsets[s] to pattern_offsets[s + 1]
+  const uint32_t *pattern_offsets = nullptr;
+  const uint32_t *patterns = nullptr;
+
+  [[nodiscard]] int size() const { return state_count; }
+
+  [[nodiscard]] int initial(Context prev) const {
+    return prev == CONTEXT_EDGE   ? initial_state
+           : prev == CONTEXT_WORD ? initial_after_word
+                                  : initial_after_non_word;
+  }
+
+  [[nodiscard]] int next(int state, unsigned char symbol) const {
+    return transitions[state * class_count + byte_class[symbol]];
+  }
+
+  [[nodiscard]] bool accepts(int state, Context next) const {
+    return accept_states[state] & accept_bit(next);
+  }
+
+  [[nodiscard]] bool has_patterns() const { return pattern_offsets; }
+
+  // pattern_entry() values of `state`, ordered by id
+  [[nodiscard]] std::span<const uint32_t> patterns_of(int state) const {
+    return {patterns + pattern_offsets[state],
+            patterns + pattern_offsets[state + 1]};
+  }
+};
+
+// Flat, integer-indexed DFA. Rows are indexed by byte class rather than by
+// byte, and -1 stands for the dead state, so a missing transition ends the
+// scan without a trap state. A scan starts from one of three initial states
+// chosen by the byte before it; they only differ when the pattern has
+// assertions.
+struct DFA_Fast {
+  int initial_state = -1;          // at the start of the text
+  int initial_after_word = -1;     // after a word byte
+  int initial_after_non_word = -1; // after any other byte
+  int class_count = 0;
+  std::array<uint8_t, 256> byte_class{}; // byte -> column
+  std::vector<int> transitions;          // state * class_count + class
+  std::vector<uint8_t> accept_states;    // accept_bit() mask per state
+  // Empty unless compiled from a pattern set; otherwise size() + 1 offsets
+  // into `patterns`, which holds pattern_entry() values ordered by id
+  std::vector<uint32_t> pattern_offsets;
+  std::vector<uint32_t> patterns;
+
+  [[nodiscard]] int size() const {
+    return static_cast<int>(accept_states.size());
+  }
+
+  [[nodiscard]] int initial(Context prev) const {
+    return prev == CONTEXT_EDGE   ? initial_state
+           : prev == CONTEXT_WORD ? initial_after_word
+                                  : initial_after_non_word;
+  }
+
+  [[nodiscard]] int next(int state, unsigned char symbol) const {
+    return transitions[state * class_count + byte_class[symbol]];
+  }
+
+  [[nodiscard]] bool accepts(int state, Context next) const {
+    return accept_states[state] & accept_bit(next);
+  }
+
+  [[nodiscard]] bool has_patterns() const { return !pattern_offsets.empty(); }
+
+  [[nodiscard]] std::span<const uint32_t> patterns_of(int state) const {
+    return std::span(patterns).subspan(
+        pattern_offsets[state],
+        pattern_offsets[state + 1] - pattern_offsets[state]);
+  }
+
+  // Copy of the arrays behind a view, e.g. of a mapped automaton
+  [[nodiscard]] static DFA_Fast from_view(const DFA_View &view);
+
+  [[nodiscard]] DFA_View view() const {
+    return {initial_state,
+            initial_after_word,
+            initial_after_non_word,
+            class_count,
+            size(),
+            byte_class.data(),
+            transitions.data(),
+            accept_states.data(),
+            has_patterns() ? pattern_offsets.data() : nullptr,
+            has_patterns() ? patterns.data() : nullptr};
+  }
+
+  // Merges equivalent states; states of a pattern set only when they also
+  // list the same patterns. States equivalent to the dead state are
+  // dropped and the rest renumbered breadth-first from the initial states.
+  [[nodiscard]] DFA_Fast minimize() const;
+
+  // Minimal DFA for "a match ends here" when matches may start anywhere:
+  // subsets of this DFA's states, joined after every byte by the initial
+  // state for that byte. A scan may stop at the first accepting state, or
+  // as soon as it dies (e.g. once a ^ anchor has failed). A subset lists
+  // every pattern its members do. Like NDFA::compile(), throws
+  // std::length_error past a nonzero `max_states` subsets.
+  [[nodiscard]] DFA_Fast unanchored(size_t max_states = 0) const;
+
+  // Minimal DFA read right to left that tells where matches start. Its
+  // states are the sets of this DFA's states that reach a match end over
+  // the bytes read so far. Started from initial(context after the text),
+  // it accepts at a position before byte b (or the start of the text) when
+  // the forward initial state for that context is in the set. Pattern ids
+  // are not carried over. `max_states` as for unanchored().
+  [[nodiscard]] DFA_Fast reversed(size_t max_states = 0) const;
+
+  // The operations below build whole-text automata: a text is accepted
+  // when the state reached after its last byte accepts CONTEXT_EDGE. Each
+  // result is minimized, and pattern lists are dropped.
+
+  // Texts that contain a match of this table, which has to be an
+  // unanchored() one: the first accepting position leads to a state that
+  // accepts whatever follows.
+  [[nodiscard]] DFA_Fast containing() const;
+
+  // Texts this DFA rejects. Missing transitions lead to an accepting sink,
+  // so the result is total.
+  [[nodiscard]] DFA_Fast complement() const;
+
+  // Texts both DFAs accept. The product runs on pairs of states, with a
+  // byte class for every pair of classes that occurs.
+  [[nodiscard]] DFA_Fast intersect(const DFA_Fast &other) const;
+};
+
+#endif // !DFA_FAST_HPP
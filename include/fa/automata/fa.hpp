@@ -11,6 +11,7 @@
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #ifndef EPSILON_DEFINED
@@ -110,6 +111,9 @@ public:
 
   [[nodiscard]] int size() const { return static_cast<int>(states.size()); }
 
+  // Renames every state to q0..qn-1 (initial state first) in one sweep over
+  // the states and transitions. Subclasses with edges of their own rename
+  // them in rename_states().
   FA &normalize_states() {
     std::map<std::string, std::string> new_names;
     if (initial_state)
@@ -122,11 +126,7 @@ public:
       }
     }
 
-    for (const auto &[old_name, new_name] : new_names)
-      _rename_state(old_name, "temp_" + new_name);
-    for (const auto &[old_name, new_name] : new_names)
-      _rename_state("temp_" + new_name, new_name);
-
+    rename_states(new_names);
     return *this;
   }
 
@@ -175,34 +175,48 @@ public:
   }
 
 protected:
-  void _rename_state(const std::string &old_name, const std::string &new_name) {
-    if (old_name == new_name)
-      return;
+  static const std::string &
+  renamed(const std::map<std::string, std::string> &new_names,
+          const std::string &name) {
+    auto it = new_names.find(name);
+    return it != new_names.end() ? it->second : name;
+  }
 
-    if (states.erase(old_name))
-      states.insert(new_name);
-    if (initial_state && *initial_state == old_name)
-      initial_state = new_name;
-    if (final_states.erase(old_name))
-      final_states.insert(new_name);
-
-    if (auto it = transitions.find(old_name); it != transitions.end()) {
-      auto nh = transitions.extract(it);
-      nh.key() = new_name;
-      transitions.insert(std::move(nh));
-    }
+  // Applies normalize_states()'s names to the states, the final states and
+  // the transitions
+  virtual void
+  rename_states(const std::map<std::string, std::string> &new_names) {
+    auto rename = [&](const std::string &name) -> const std::string & {
+      return renamed(new_names, name);
+    };
 
-    for (auto &[src, symbol_map] : transitions) {
-      for (auto &[sym, target] : symbol_map) {
+    std::set<std::string> renamed_states;
+    for (const auto &[old_name, new_name] : new_names)
+      renamed_states.insert(new_name);
+
+    std::set<std::string> renamed_finals;
+    for (const auto &state : final_states)
+      renamed_finals.insert(rename(state));
+
+    std::map<std::string, std::map<char, T>> renamed_transitions;
+    for (const auto &[src, symbol_map] : transitions) {
+      auto &row = renamed_transitions[rename(src)];
+      for (const auto &[sym, target] : symbol_map) {
         if constexpr (std::is_same_v<T, std::set<std::string>>) {
-          if (target.erase(old_name))
-            target.insert(new_name);
+          auto &targets = row[sym];
+          for (const auto &t : target)
+            targets.insert(rename(t));
         } else {
-          if (target == old_name)
-            target = new_name;
+          row[sym] = rename(target);
         }
       }
     }
+
+    if (initial_state)
+      initial_state = renamed(new_names, *initial_state);
+    states = std::move(renamed_states);
+    final_states = std::move(renamed_finals);
+    transitions = std::move(renamed_transitions);
   }
 };
 #endif // !FA_HPP
@@ -1,27 +1,124 @@
 #ifndef NDFA_HPP
 #define NDFA_HPP
 
+#include "byte_classes.hpp"
 #include "dfa.hpp"
+#include "dfa_fast.hpp"
 #include "fa.hpp"
+#include "state_set.hpp"
+#include <bitset>
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
+
+// Zero-width conditions on the bytes around a position. The last two are
+// the halves of a word boundary that -w puts around a pattern.
+enum class Assertion : uint8_t {
+  LINE_START,
+  LINE_END,
+  WORD_BOUNDARY,
+  NOT_WORD_BOUNDARY,
+  NOT_AFTER_WORD,
+  NOT_BEFORE_WORD
+};
+
+[[nodiscard]] bool assertion_holds(Assertion a, Context prev, Context next);
+
+// Integer view of an NDFA. States are numbered in the order of
+// NDFA::get_states() and every epsilon closure is computed once, so the
+// closure of a set of states is the union of the closures of its members.
+struct NDFAIndex {
+  std::vector<std::string> names;
+  int initial = -1;
+  StateSet finals;
+  ByteClasses classes; // alphabet partitioned by every edge label
+  // Per state: (byte class, target state)
+  std::vector<std::vector<std::pair<int, int>>> edges;
+  std::vector<StateSet> closures;
+  // Per state: (assertion, target state); not part of the closures
+  std::vector<std::vector<std::pair<Assertion, int>>> assertions;
+  bool has_assertions = false;
+  // Per state: the pattern a tagged final state belongs to, -1 otherwise
+  std::vector<int64_t> final_pattern;
+  bool has_patterns = false;
+
+  [[nodiscard]] StateSet closure(const StateSet &states) const;
+
+  // Closed set extended through every assertion edge that holds between
+  // the `prev` and `next` contexts
+  [[nodiscard]] StateSet resolve(const StateSet &states, Context prev,
+                                 Context next) const;
+};
 
 class NDFA : public FA<std::set<std::string>> {
+protected:
+  // Edges labelled with a whole set of bytes, e.g. the ones built for a
+  // character class. They are kept apart from `transitions` so a class does
+  // not turn into one edge per byte.
+  std::map<std::string,
+           std::vector<std::pair<std::bitset<256>, std::string>>>
+      class_transitions;
+  // Epsilon edges taken only where an assertion holds
+  std::map<std::string, std::vector<std::pair<Assertion, std::string>>>
+      assertion_transitions;
+  // Final states that end one pattern of a set, with the pattern's id
+  std::map<std::string, uint32_t> final_patterns;
+
 public:
   NDFA() : FA<std::set<std::string>>() {}
 
+  void add_class_transition(const std::string &from,
+                            const std::bitset<256> &symbols,
+                            const std::string &to);
+
+  [[nodiscard]] const std::map<
+      std::string, std::vector<std::pair<std::bitset<256>, std::string>>> &
+  get_class_transitions() const {
+    return class_transitions;
+  }
+
+  void add_assertion_transition(const std::string &from, Assertion assertion,
+                                const std::string &to);
+
+  [[nodiscard]] const std::map<
+      std::string, std::vector<std::pair<Assertion, std::string>>> &
+  get_assertion_transitions() const {
+    return assertion_transitions;
+  }
+
+  // Marks a final state as the end of pattern `pattern`; the compiled table
+  // then lists, per state, which patterns match (DFA_Fast::patterns)
+  void tag_final_state(const std::string &state, uint32_t pattern);
+
+  [[nodiscard]] const std::map<std::string, uint32_t> &
+  get_final_patterns() const {
+    return final_patterns;
+  }
+
+  [[nodiscard]] std::string transitions_table() const;
+
+  [[nodiscard]] NDFAIndex index() const;
+
+  // Throws std::invalid_argument for an NDFA with assertions, which a
+  // string-keyed DFA cannot express
   [[nodiscard]] std::unique_ptr<DFA> determinize() const;
 
-protected:
-  [[nodiscard]] std::set<std::string>
-  epsilon_closure(const std::set<std::string> &states) const;
+  // Subset construction and minimization straight into a flat table,
+  // without building any string-keyed DFA on the way. With a nonzero
+  // `max_states`, throws std::length_error as soon as the construction
+  // needs more states than that, before minimizing.
+  [[nodiscard]] DFA_Fast compile(size_t max_states = 0) const;
 
-  [[nodiscard]] std::set<std::string>
-  epsilon_closure(const std::string &state) const;
+protected:
+  // Also renames the class and assertion edges and the pattern tags
+  void rename_states(
+      const std::map<std::string, std::string> &new_names) override;
 
-  [[nodiscard]] std::set<std::string> move(const std::set<std::string> &states,
-                                           char symbol) const;
+  [[nodiscard]] DFA_Fast subset_construction(const NDFAIndex &idx,
+                                             size_t max_states = 0) const;
 };
 
 #endif // !NDFA_HPP
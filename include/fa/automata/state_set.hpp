@@ -0,0 +1,73 @@
+#ifndef STATE_SET_HPP
+#define STATE_SET_HPP
+
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Dynamic bitset over dense state ids. Used for epsilon closures and subset
+// construction, where the union of two sets is a word-wise OR.
+class StateSet {
+private:
+  std::vector<uint64_t> words;
+
+public:
+  StateSet() = default;
+  explicit StateSet(size_t n) : words((n + 63) / 64, 0) {}
+
+  void insert(size_t i) { words[i >> 6] |= uint64_t(1) << (i & 63); }
+
+  [[nodiscard]] bool contains(size_t i) const {
+    return (words[i >> 6] >> (i & 63)) & 1;
+  }
+
+  [[nodiscard]] bool empty() const {
+    for (uint64_t w : words)
+      if (w)
+        return false;
+    return true;
+  }
+
+  [[nodiscard]] bool intersects(const StateSet &other) const {
+    for (size_t i = 0; i < words.size() && i < other.words.size(); i++)
+      if (words[i] & other.words[i])
+        return true;
+    return false;
+  }
+
+  StateSet &operator|=(const StateSet &other) {
+    if (other.words.size() > words.size())
+      words.resize(other.words.size(), 0);
+    for (size_t i = 0; i < other.words.size(); i++)
+      words[i] |= other.words[i];
+    return *this;
+  }
+
+  template <typename F> void for_each(F &&f) const {
+    for (size_t i = 0; i < words.size(); i++) {
+      uint64_t w = words[i];
+      while (w) {
+        f(i * 64 + std::countr_zero(w));
+        w &= w - 1;
+      }
+    }
+  }
+
+  [[nodiscard]] size_t hash() const {
+    size_t h = words.size();
+    for (uint64_t w : words)
+      h ^= w + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+  }
+
+  bool operator==(const StateSet &) const = default;
+  auto operator<=>(const StateSet &) const = default;
+};
+
+struct StateSetHash {
+  size_t operator()(const StateSet &s) const { return s.hash(); }
+};
+
+#endif // !STATE_SET_HPP
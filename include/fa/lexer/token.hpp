@@ -19,6 +19,8 @@ typedef enum {
   // ESPECIALS
   LAMBDA,
   EMPTY,
+  ASSERTION, // value: '^', '$', 'b' or 'B'
+
 
   // CONTROL
   END,
@@ -0,0 +1,224 @@
+#ifndef COMPILED_HPP
+#define COMPILED_HPP
+
+#include "../automata/dfa_fast.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fa::regex {
+
+// Settings that change the language an automaton accepts; they are part of
+// every cache key and recorded in serialized automata
+struct CompileOptions {
+  bool ignore_case = false; // -i: letters match both cases
+  bool word_regexp = false; // -w: no word byte right before or after
+  bool line_regexp = false; // -x: the match spans the whole text
+
+  // Letters of the options that are set, e.g. "iw"
+  [[nodiscard]] std::string letters() const {
+    std::string s;
+    if (ignore_case)
+      s += 'i';
+    if (word_regexp)
+      s += 'w';
+    if (line_regexp)
+      s += 'x';
+    return s;
+  }
+
+  bool operator==(const CompileOptions &) const = default;
+};
+
+struct MatchSpan {
+  size_t start = 0;
+  size_t length = 0;
+};
+
+class CompiledRegex;
+
+// Spans of CompiledRegex::find_all(), produced one at a time:
+//   for (MatchSpan span : regex.find_all(text)) ...
+// When the text has a match, match_lengths() works out the longest match
+// at every position once, in linear time, into an array held inside the
+// range for texts of up to INLINE_LENGTHS bytes and allocated with it for
+// longer ones; match_lengths() also allocates its own working state. Each
+// step then jumps to the next start not yet covered, so nothing is
+// allocated per match. The range must outlive its iterators and can be
+// neither copied nor moved.
+class MatchRange {
+public:
+  class iterator {
+  public:
+    using value_type = MatchSpan;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+    const MatchSpan &operator*() const { return current; }
+    const MatchSpan *operator->() const { return &current; }
+    iterator &operator++();
+    void operator++(int) { ++*this; }
+    bool operator==(std::default_sentinel_t) const { return done; }
+
+  private:
+    friend class MatchRange;
+    explicit iterator(const MatchRange *range);
+
+    const MatchRange *range = nullptr;
+    MatchSpan current;
+    size_t from = 0; // first position not yet covered
+    bool done = true;
+  };
+
+  // 1 KiB of lengths: most lines fit without touching the heap
+  static constexpr size_t INLINE_LENGTHS = 256;
+
+  MatchRange(const CompiledRegex &regex, std::string_view text);
+  MatchRange(const MatchRange &) = delete;
+  MatchRange &operator=(const MatchRange &) = delete;
+
+  iterator begin() const { return iterator(this); }
+  std::default_sentinel_t end() const { return {}; }
+
+private:
+  const CompiledRegex &regex;
+  std::string_view text;
+  const uint32_t *lengths = nullptr; // match_lengths(); null if no match
+  std::array<uint32_t, INLINE_LENGTHS> inline_lengths;
+  std::unique_ptr<uint32_t[]> heap_lengths; // texts over INLINE_LENGTHS
+};
+
+// Immutable product of Regex::compile(): the minimized transition table, its
+// unanchored search and reversed automata and a literal prefilter. The two
+// derived automata are built on first use, each at most once and under
+// DERIVED_STATE_BUDGET; nothing else is written after construction, so one
+// instance can be shared read-only across threads.
+class CompiledRegex {
+public:
+  struct Derived; // search or reverse table; defined in compiled.cpp
+
+private:
+  std::shared_ptr<const void> storage; // owns the arrays the views point into
+  DFA_View dfa;
+  std::shared_ptr<Derived> search;  // dfa.unanchored()
+  std::shared_ptr<Derived> reverse; // dfa.reversed()
+  std::string prefix; // bytes every match has to start with
+  CompileOptions compile_options;
+  uint32_t n_patterns = 1;
+
+  // The anchored table reaches an accepting state from `start`
+  bool match_from(std::string_view text, size_t start) const;
+
+public:
+  // States the search or reverse automaton may grow to while it is built.
+  // One that would need more is not built: the methods that use it run
+  // the anchored table from every candidate start instead.
+  static constexpr size_t DERIVED_STATE_BUDGET = 20000;
+
+  // A table compiled from a pattern set lists its patterns per state, and
+  // `pattern_count` says how many there are
+  explicit CompiledRegex(DFA_Fast table, CompileOptions options = {},
+                         uint32_t pattern_count = 1);
+  explicit CompiledRegex(std::shared_ptr<const DFA_Fast> table,
+                         CompileOptions options = {},
+                         uint32_t pattern_count = 1);
+
+  // Takes `search` and `reverse` as already derived from `table`, e.g.
+  // under a state budget
+  CompiledRegex(DFA_Fast table, DFA_Fast search, DFA_Fast reverse,
+                CompileOptions options = {}, uint32_t pattern_count = 1);
+
+  // Runs on arrays kept alive by `storage`, e.g. a mapped file; nothing is
+  // copied or recomputed. A missing search or reverse table is one that did
+  // not fit the budget.
+  CompiledRegex(DFA_View table, std::optional<DFA_View> search,
+                std::optional<DFA_View> reverse, std::string prefix,
+                std::shared_ptr<const void> storage,
+                CompileOptions options = {}, uint32_t pattern_count = 1);
+
+  // The whole of `word` is a match; assertions see its ends as line ends
+  bool match(std::string_view word) const;
+
+  // match() of every word at once: bit i % 8 of out[i / 8] is set when
+  // words[i] matches. Words are sorted by length, a block at a time, and
+  // walked through the table MATCH_LANES at a time, one byte of each per
+  // step, so the table loads of the lanes overlap instead of waiting on
+  // each other. `out` needs (words.size() + 7) / 8 bytes and is cleared
+  // first; a shorter one throws std::invalid_argument.
+  static constexpr size_t MATCH_LANES = 8;
+  void match_many(std::span<const std::string_view> words,
+                  std::span<uint8_t> out) const;
+
+  // Some substring of `text` is a match. One pass over the search
+  // automaton that stops at the first match, or at the first byte after
+  // which none is possible any more; without one, the anchored table is
+  // run from every start the literal prefix allows.
+  bool contains(std::string_view text) const;
+
+  // Length of the longest match starting at `start`, -1 if there is none.
+  // Assertions see the bytes around it, not the ends of the span.
+  long longest_match_at(std::string_view text, size_t start) const;
+
+  // Sets bit i of `bits` (bit i % 64 of word i / 64) when some match
+  // begins at i, for i up to text.size(); one right-to-left pass over the
+  // reverse automaton, or, without one, the anchored table run from every
+  // position. `bits` needs text.size() / 64 + 1 words and is cleared
+  // first.
+  void match_starts(std::string_view text, std::span<uint64_t> bits) const;
+
+  // lengths[i] is the length of the longest non-empty match starting at
+  // i, 0 if there is none; a length that does not fit is stored as
+  // LONG_MATCH and has to be asked of longest_match_at(). One forward pass
+  // runs a thread from every start match_starts() marks, one thread per
+  // state: a thread reaching a state another one holds merges into the
+  // one that started first, since from there on they match the same ends,
+  // and the merges are resolved afterwards from the last to the first. The
+  // work is O(text.size() * states), not one extension per start: the
+  // number of thread steps taken is returned, and never exceeds that.
+  // `lengths` needs text.size() entries.
+  static constexpr uint32_t LONG_MATCH = UINT32_MAX;
+  size_t match_lengths(std::string_view text,
+                       std::span<uint32_t> lengths) const;
+
+  // Leftmost-longest, non-overlapping, non-empty matches of `text`, left to
+  // right, taken greedily from match_lengths(); no match is tried length
+  // by length and no span is extended more than once. `out` is cleared
+  // first.
+  void find_all(std::string_view text, std::vector<MatchSpan> &out) const;
+
+  // The same spans as a lazy range that allocates nothing per match
+  MatchRange find_all(std::string_view text) const {
+    return MatchRange(*this, text);
+  }
+
+  // Ids of the patterns of a set with some match in `text`, ascending; for
+  // a single pattern {0} if it matches. Unlike contains() the pass goes on
+  // after the first match, until every pattern has matched or none can any
+  // more. `out` is cleared first.
+  void matching_patterns(std::string_view text,
+                         std::vector<uint32_t> &out) const;
+
+  // First position >= from where a match could start, judging only by the
+  // literal prefix (text.size() when no such position is left). Without a
+  // prefix every position qualifies.
+  size_t next_candidate(std::string_view text, size_t from) const;
+
+  const DFA_View &table() const { return dfa; }
+  // Built on first use; null when it would exceed DERIVED_STATE_BUDGET
+  const DFA_View *search_table() const;
+  const DFA_View *reverse_table() const;
+  const std::string &literal_prefix() const { return prefix; }
+  const CompileOptions &options() const { return compile_options; }
+  uint32_t pattern_count() const { return n_patterns; }
+};
+
+} // namespace fa::regex
+
+#endif // !COMPILED_HPP
@@ -0,0 +1,63 @@
+#ifndef DISK_CACHE_HPP
+#define DISK_CACHE_HPP
+
+#include "compiled.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+namespace fa::regex {
+
+/*
+ * Directory of compiled automata, one file per key named after a hash of
+ * it and holding the key itself. Entries are written to a temporary file and renamed into place, so a
+ * concurrent reader sees either the old entry or the whole new one. Loading
+ * an entry marks it as recently used; once the directory outgrows
+ * `max_bytes`, store() removes the least recently used entries. Temporary
+ * files count towards `max_bytes` too, and store() removes the ones over a
+ * minute old, left behind by a process that died while writing.
+ */
+class DiskCache {
+private:
+  std::filesystem::path dir;
+  uintmax_t max_bytes;
+
+public:
+  static constexpr uintmax_t DEFAULT_MAX_BYTES = 64 << 20;
+
+  // Bumped whenever compiling may build a different automaton for the same
+  // pattern and flags while the file format stays the same; rebuilding the
+  // binary alone does not invalidate the cache
+  static constexpr const char *ENGINE_VERSION = "engine-1";
+
+  explicit DiskCache(std::filesystem::path dir,
+                     uintmax_t max_bytes = DEFAULT_MAX_BYTES);
+
+  // $XDG_CACHE_HOME/mygrep, else $HOME/.cache/mygrep; empty if neither is set
+  static std::filesystem::path default_dir();
+
+  // Key covering everything that changes the automaton: the pattern, the
+  // flags it was compiled for and the file format and engine versions. It
+  // is the same for every build, so the cache survives a rebuild.
+  static std::string make_key(const std::string &pattern,
+                              const std::string &flags);
+
+  std::filesystem::path entry_path(const std::string &key) const;
+
+  // nullptr when the entry is missing, unusable or stored under another key
+  // with the same file name; such an entry is removed so the next store()
+  // replaces it
+  std::shared_ptr<const CompiledRegex> load(const std::string &key) const;
+
+  // Throws std::runtime_error or std::filesystem::filesystem_error when the
+  // entry cannot be written
+  void store(const std::string &key, const CompiledRegex &regex) const;
+
+private:
+  void evict() const;
+};
+
+} // namespace fa::regex
+
+#endif // !DISK_CACHE_HPP
@@ -0,0 +1,72 @@
+#ifndef PATTERN_SET_HPP
+#define PATTERN_SET_HPP
+
+#include "compiled.hpp"
+#include "regex.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace fa::regex {
+
+/*
+ * A set of patterns compiled into as few automata as a state budget
+ * allows. Patterns are taken in order and grouped greedily: each shard
+ * grows (doubling, then backing off) for as long as compile_set() stays
+ * under the budget, so a rule set whose union would explode degrades to a
+ * handful of passes instead of failing. A pattern too large on its own
+ * gets a shard without a budget. Shards hold consecutive pattern ids, and
+ * every query runs them one after the other over the same text, while it
+ * is still in cache, and merges what they find.
+ */
+class PatternSet {
+public:
+  // Subsets per table while a shard is built
+  static constexpr size_t DEFAULT_STATE_BUDGET = 20000;
+
+  PatternSet(const std::vector<std::shared_ptr<Regex>> &patterns,
+             const CompileOptions &options = {},
+             size_t state_budget = DEFAULT_STATE_BUDGET);
+
+  // A single automaton, e.g. a loaded or cached one, as a one-shard set
+  explicit PatternSet(std::shared_ptr<const CompiledRegex> compiled);
+
+  // Shards built earlier, e.g. loaded from a cache, in pattern id order
+  explicit PatternSet(
+      std::vector<std::shared_ptr<const CompiledRegex>> compiled);
+
+  // Some shard matches somewhere in `text`
+  bool contains(std::string_view text) const;
+
+  // Ids of the patterns with a match in `text`, ascending; `out` is
+  // cleared first
+  void matching_patterns(std::string_view text,
+                         std::vector<uint32_t> &out) const;
+
+  // Leftmost-longest spans of the union of every shard, as
+  // CompiledRegex::find_all() would give for a single automaton: the
+  // match lengths of all shards are merged before any span is taken
+  void find_all(std::string_view text, std::vector<MatchSpan> &out) const;
+
+  uint32_t pattern_count() const { return n_patterns; }
+  size_t shard_count() const { return shards.size(); }
+  const CompiledRegex &shard(size_t i) const { return *shards[i].compiled; }
+  std::shared_ptr<const CompiledRegex> shard_handle(size_t i) const {
+    return shards[i].compiled;
+  }
+
+private:
+  struct Shard {
+    std::shared_ptr<const CompiledRegex> compiled;
+    uint32_t first_id = 0; // its local id 0
+  };
+
+  std::vector<Shard> shards;
+  uint32_t n_patterns = 0;
+};
+
+} // namespace fa::regex
+
+#endif // !PATTERN_SET_HPP
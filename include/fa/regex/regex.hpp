@@ -1,62 +1,195 @@
 #ifndef REGEX_HPP
 #define REGEX_HPP
 #include "../automata/dfa.hpp"
+#include "../automata/dfa_fast.hpp"
 #include "../automata/ndfa.hpp"
+#include "compiled.hpp"
+#include <array>
 #include <bitset>
 #include <memory>
+#include <mutex>
+#include <span>
 #include <string>
 #include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 namespace fa::regex {
 
-struct DFA_Fast {
-  int initial_state = -1;
-  std::vector<std::array<int, 256>> transitions;
-  std::vector<bool> accept_states;
+using ::DFA_Fast;
+
+class Regex;
+
+// Thompson NFA of a whole tree, built once with numbered states. Each
+// subtree adds one contiguous block of states; a node met again (after
+// interning, any equal subtree) is spliced in by copying its block with the
+// numbers shifted, so no fragment is copied once per level of nesting and
+// state names do not grow with the depth of the tree.
+class ThompsonNFA {
+public:
+  struct Fragment {
+    int begin = 0; // block of states [begin, end)
+    int end = 0;
+    int entry = 0;
+    std::vector<int> exits;
+    // Epsilon edges an exit had when the fragment was built; the ones a
+    // parent adds later lead out of the block and are not spliced
+    std::vector<size_t> exit_edges;
+  };
+
+  int add_state();
+  void add_edge(int from, char symbol, int to); // '\0' is epsilon
+  void add_class_edge(int from, const std::bitset<256> &symbols, int to);
+  void add_assertion_edge(int from, Assertion assertion, int to);
+
+  // Copy of an earlier fragment appended as a new block
+  Fragment splice(const Fragment &fragment);
+
+  // String-named NDFA with `root`'s entry as initial state and its exits
+  // as final states
+  std::unique_ptr<NDFA> to_ndfa(const Fragment &root) const;
+
+  size_t size() const { return edges.size(); }
+  size_t edge_count() const; // of every kind
+  size_t fragment_count() const { return built.size(); }
+
+private:
+  friend class Regex;
+  std::vector<std::vector<std::pair<char, int>>> edges;
+  std::vector<std::vector<std::pair<std::bitset<256>, int>>> class_edges;
+  std::vector<std::vector<std::pair<Assertion, int>>> assertion_edges;
+  std::unordered_map<const Regex *, Fragment> built;
 };
 
+class RegexTable;
+
 class Regex {
 
 protected:
+  // Lazily filled by dfa() and match(); the once_flags make the first call
+  // safe from several threads
+  mutable std::once_flag _dfa_once;
   mutable std::unique_ptr<DFA> _dfa_cache;
-  mutable std::unique_ptr<DFA_Fast> _dfa_fast_cache;
+  mutable std::once_flag _compiled_once;
+  mutable std::shared_ptr<const DFA_Fast> _fast_cache;
+  mutable std::shared_ptr<const CompiledRegex> _compiled_cache;
+  size_t _hash = 0; // structural hash, set by every constructor
+
+  // Adds this node's states to `nfa`, reaching children through to_ndfa()
+  virtual ThompsonNFA::Fragment build_ndfa(ThompsonNFA &nfa) const = 0;
 
 public:
   Regex() : _dfa_cache(nullptr) {}
   virtual ~Regex();
 
+  // String-keyed minimal DFA, kept for transitions_table() debugging
   const DFA *dfa() const;
 
+  // Flat table compiled straight from the NDFA; this is what match() runs
+  const DFA_Fast *fast_dfa() const;
+
+  // Builds a new immutable matcher on every call; share the handle instead
+  // of the Regex between threads
+  std::shared_ptr<const CompiledRegex>
+  compile(const CompileOptions &options = {}) const;
+
   bool match(std::string_view word) const;
 
-  virtual std::unique_ptr<NDFA> to_ndfa() const = 0;
+  // CompiledRegex::match_many() on the cached matcher
+  void match_many(std::span<const std::string_view> words,
+                  std::span<uint8_t> out) const;
+
+  std::unique_ptr<NDFA> to_ndfa() const;
+  // Builds this node into `nfa` the first time, splices a copy after that
+  ThompsonNFA::Fragment to_ndfa(ThompsonNFA &nfa) const;
+
+  size_t hash() const { return _hash; }
+
   virtual bool _atomic() const = 0;
   virtual std::string to_string() const = 0;
+
+  // Equivalent, smaller tree: n-ary unions flattened, single-character
+  // alternatives merged into one Range, nested stars collapsed and common
+  // prefixes/suffixes of alternatives factored out. Runs before to_ndfa()
+  // when compiling.
+  virtual std::shared_ptr<Regex> simplify() const = 0;
+  virtual bool equals(const Regex &other) const = 0;
+
+  // Rebuilds the tree through the table so equal subtrees become one node
+  virtual std::shared_ptr<Regex> intern(RegexTable &table) const = 0;
+
+  // Same tree with every ASCII letter standing for both of its cases: a
+  // Char becomes a two-byte Range and classes are folded before negation
+  virtual std::shared_ptr<Regex> fold_case() const = 0;
+};
+
+// One matcher for a set of patterns: the union of their automata, each
+// with an accepting exit tagged with its index, so one pass over a text
+// tells which of them match (CompiledRegex::matching_patterns). The options
+// apply to every pattern; null patterns never match but keep their index.
+// A nonzero `max_states` bounds each of the three tables while they are
+// built, and std::length_error is thrown when one would need more; see
+// PatternSet for splitting a set that does not fit. With no bound the
+// derived tables are left to CompiledRegex to build on first use.
+std::shared_ptr<const CompiledRegex>
+compile_set(const std::vector<std::shared_ptr<Regex>> &patterns,
+            const CompileOptions &options = {}, size_t max_states = 0);
+
+// Hash-consing table: structurally equal nodes map to one shared instance
+class RegexTable {
+private:
+  std::unordered_map<size_t, std::vector<std::shared_ptr<Regex>>> buckets;
+  size_t count = 0;
+
+public:
+  std::shared_ptr<Regex> insert(std::shared_ptr<Regex> node);
+  size_t size() const { return count; }
 };
 
 class Empty : public Regex {
+protected:
+  ThompsonNFA::Fragment build_ndfa(ThompsonNFA &nfa) const override;
+
 public:
-  std::unique_ptr<NDFA> to_ndfa() const override;
+  Empty();
   bool _atomic() const override;
   std::string to_string() const override;
+  std::shared_ptr<Regex> simplify() const override;
+  bool equals(const Regex &other) const override;
+  std::shared_ptr<Regex> intern(RegexTable &table) const override;
+  std::shared_ptr<Regex> fold_case() const override;
 };
 
 class Lambda : public Regex {
+protected:
+  ThompsonNFA::Fragment build_ndfa(ThompsonNFA &nfa) const override;
+
 public:
-  std::unique_ptr<NDFA> to_ndfa() const override;
+  Lambda();
   bool _atomic() const override;
   std::string to_string() const override;
+  std::shared_ptr<Regex> simplify() const override;
+  bool equals(const Regex &other) const override;
+  std::shared_ptr<Regex> intern(RegexTable &table) const override;
+  std::shared_ptr<Regex> fold_case() const override;
 };
 
 class Char : public Regex {
 private:
   char symbol;
 
+protected:
+  ThompsonNFA::Fragment build_ndfa(ThompsonNFA &nfa) const override;
+
 public:
   explicit Char(char c);
-  std::unique_ptr<NDFA> to_ndfa() const override;
+  char get_symbol() const { return symbol; }
   bool _atomic() const override;
   std::string to_string() const override;
+  std::shared_ptr<Regex> simplify() const override;
+  bool equals(const Regex &other) const override;
+  std::shared_ptr<Regex> intern(RegexTable &table) const override;
+  std::shared_ptr<Regex> fold_case() const override;
 };
 
 class Concat : public Regex {
@@ -64,45 +197,96 @@ private:
   std::shared_ptr<Regex> expr1;
   std::shared_ptr<Regex> expr2;
 
+protected:
+  ThompsonNFA::Fragment build_ndfa(ThompsonNFA &nfa) const override;
+
 public:
   Concat(std::shared_ptr<Regex> e1, std::shared_ptr<Regex> e2);
-  std::unique_ptr<NDFA> to_ndfa() const override;
+  const std::shared_ptr<Regex> &get_left() const { return expr1; }
+  const std::shared_ptr<Regex> &get_right() const { return expr2; }
   bool _atomic() const override;
   std::string to_string() const override;
+  std::shared_ptr<Regex> simplify() const override;
+  bool equals(const Regex &other) const override;
+  std::shared_ptr<Regex> intern(RegexTable &table) const override;
+  std::shared_ptr<Regex> fold_case() const override;
 };
 
 class Union : public Regex {
 private:
-  std::shared_ptr<Regex> expr1;
-  std::shared_ptr<Regex> expr2;
+  std::vector<std::shared_ptr<Regex>> alternatives;
+
+protected:
+  ThompsonNFA::Fragment build_ndfa(ThompsonNFA &nfa) const override;
 
 public:
   Union(std::shared_ptr<Regex> e1, std::shared_ptr<Regex> e2);
-  std::unique_ptr<NDFA> to_ndfa() const override;
+  explicit Union(std::vector<std::shared_ptr<Regex>> alts);
+  const std::vector<std::shared_ptr<Regex>> &get_alternatives() const {
+    return alternatives;
+  }
   bool _atomic() const override;
   std::string to_string() const override;
+  std::shared_ptr<Regex> simplify() const override;
+  bool equals(const Regex &other) const override;
+  std::shared_ptr<Regex> intern(RegexTable &table) const override;
+  std::shared_ptr<Regex> fold_case() const override;
 };
 
 class Star : public Regex {
 private:
   std::shared_ptr<Regex> expr;
 
+protected:
+  ThompsonNFA::Fragment build_ndfa(ThompsonNFA &nfa) const override;
+
 public:
   explicit Star(std::shared_ptr<Regex> e);
-  std::unique_ptr<NDFA> to_ndfa() const override;
+  const std::shared_ptr<Regex> &get_expr() const { return expr; }
   bool _atomic() const override;
   std::string to_string() const override;
+  std::shared_ptr<Regex> simplify() const override;
+  bool equals(const Regex &other) const override;
+  std::shared_ptr<Regex> intern(RegexTable &table) const override;
+  std::shared_ptr<Regex> fold_case() const override;
 };
 
 class Plus : public Regex {
 private:
   std::shared_ptr<Regex> expr;
 
+protected:
+  ThompsonNFA::Fragment build_ndfa(ThompsonNFA &nfa) const override;
+
 public:
   explicit Plus(std::shared_ptr<Regex> e);
-  std::unique_ptr<NDFA> to_ndfa() const override;
+  const std::shared_ptr<Regex> &get_expr() const { return expr; }
   bool _atomic() const override;
   std::string to_string() const override;
+  std::shared_ptr<Regex> simplify() const override;
+  bool equals(const Regex &other) const override;
+  std::shared_ptr<Regex> intern(RegexTable &table) const override;
+  std::shared_ptr<Regex> fold_case() const override;
+};
+
+// Zero-width assertion: ^, $, /b, /B, or one side of the word boundary that
+// -w adds around a pattern
+class Assert : public Regex {
+private:
+  Assertion kind;
+
+protected:
+  ThompsonNFA::Fragment build_ndfa(ThompsonNFA &nfa) const override;
+
+public:
+  explicit Assert(Assertion a);
+  Assertion get_kind() const { return kind; }
+  bool _atomic() const override;
+  std::string to_string() const override;
+  std::shared_ptr<Regex> simplify() const override;
+  bool equals(const Regex &other) const override;
+  std::shared_ptr<Regex> intern(RegexTable &table) const override;
+  std::shared_ptr<Regex> fold_case() const override;
 };
 
 struct CharClass {
@@ -118,17 +302,36 @@ struct CharClass {
   bool matches(unsigned char c) const {
     return negate ? !bits.test(c) : bits.test(c);
   }
+
+  // Adds the other case of every ASCII letter in the set
+  void fold_case() {
+    for (int c = 'a'; c <= 'z'; c++)
+      if (bits.test(c) || bits.test(c - 'a' + 'A')) {
+        bits.set(c);
+        bits.set(c - 'a' + 'A');
+      }
+  }
+
+  // Bytes actually matched, with the negation applied
+  std::bitset<256> effective() const { return negate ? ~bits : bits; }
 };
 
 class Range : public Regex {
 private:
   CharClass cls;
 
+protected:
+  ThompsonNFA::Fragment build_ndfa(ThompsonNFA &nfa) const override;
+
 public:
   explicit Range(const CharClass &char_class);
-  std::unique_ptr<NDFA> to_ndfa() const override;
+  const CharClass &get_char_class() const { return cls; }
   bool _atomic() const override;
   std::string to_string() const override;
+  std::shared_ptr<Regex> simplify() const override;
+  bool equals(const Regex &other) const override;
+  std::shared_ptr<Regex> intern(RegexTable &table) const override;
+  std::shared_ptr<Regex> fold_case() const override;
 };
 
 } // namespace fa::regex
@@ -0,0 +1,93 @@
+#ifndef REGEX_CACHE_HPP
+#define REGEX_CACHE_HPP
+
+#include "compiled.hpp"
+#include "regex.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fa::regex {
+
+struct RegexCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  size_t table_bytes = 0;
+};
+
+/*
+ * Thread-safe LRU of compiled patterns for programs that see the same few
+ * patterns over and over. Keys are the parsed and simplified tree, compared
+ * structurally as RegexTable does, plus the option letters it is compiled
+ * with, so `a|b`, `(a|b)` and `a|b|a` share one entry. The cache
+ * is split into shards, each with its own lock and its own share of the
+ * byte budget, so lookups of different patterns rarely contend; a pattern
+ * larger than one share is compiled but never cached, so together the
+ * shards never hold more than `max_table_bytes`. Budget is counted in
+ * table bytes, see table_bytes(); handles already returned stay valid
+ * after their entry is evicted. The parser is supplied by the caller,
+ * typically Parser(pattern).parse().
+ */
+class RegexCache {
+public:
+  using Parse =
+      std::function<std::shared_ptr<Regex>(const std::string &pattern)>;
+
+  RegexCache(Parse parse, size_t max_table_bytes, size_t shard_count = 16);
+
+  // Parses on every call and compiles on a miss, outside the shard lock;
+  // parse and compile errors propagate and nothing is cached for the key
+  std::shared_ptr<const CompiledRegex>
+  get(const std::string &pattern, const CompileOptions &options = {});
+
+  RegexCacheStats stats() const;
+
+  // Bytes of the anchored, search and reverse tables with their pattern
+  // lists. The last two are built here, under their state budget, so an
+  // entry does not grow after it is admitted.
+  static size_t table_bytes(const CompiledRegex &regex);
+
+private:
+  struct Key {
+    std::string options; // CompileOptions::letters()
+    std::shared_ptr<Regex> tree;
+    bool operator==(const Key &other) const {
+      return options == other.options && tree->equals(*other.tree);
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      return key.tree->hash() ^ std::hash<std::string>{}(key.options);
+    }
+  };
+  using Entry = std::pair<Key, std::shared_ptr<const CompiledRegex>>;
+
+  struct Shard {
+    mutable std::mutex lock;
+    std::list<Entry> lru; // most recently used first
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+    size_t bytes = 0;
+  };
+
+  Parse parse;
+  size_t max_table_bytes;
+  size_t shard_budget;
+  std::vector<Shard> shards;
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> evictions{0};
+};
+
+} // namespace fa::regex
+
+#endif // !REGEX_CACHE_HPP
@@ -0,0 +1,62 @@
+#ifndef SCANNER_HPP
+#define SCANNER_HPP
+
+#include "compiled.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+
+namespace fa::regex {
+
+// A line with a match, in offsets from the start of the stream
+struct ScanMatch {
+  uint64_t line = 0;       // 1-based
+  uint64_t line_start = 0; // first byte of the line
+  uint64_t line_end = 0;   // its '\n', or the end of the stream
+  uint64_t match_end = 0;  // where the line's earliest-ending match ends
+};
+
+/*
+ * Line-by-line search over a stream that arrives in arbitrary chunks. The
+ * search automaton's state, the line number and the offsets of the
+ * current line are carried from one feed() to the next, so a line split
+ * across chunks is never put back together and nothing is copied. A line
+ * is reported once, when its end is seen; after its first match, or once
+ * no match is possible any more, the rest of it is skipped with memchr.
+ * Assertions see each line on its own, as regex_engine does.
+ */
+class Scanner {
+public:
+  using Callback = std::function<void(const ScanMatch &)>;
+
+  // Throws std::length_error if the regex has no search automaton, i.e. one
+  // would exceed CompiledRegex::DERIVED_STATE_BUDGET
+  Scanner(std::shared_ptr<const CompiledRegex> regex, Callback on_match);
+
+  void feed(std::span<const char> chunk);
+
+  // Ends the stream: a last line without '\n' is reported if it matches.
+  // The scanner is then ready for a new stream.
+  void finish();
+
+  uint64_t offset() const { return position; } // bytes fed so far
+  uint64_t lines() const { return line; }      // lines started so far
+
+private:
+  void end_line(uint64_t end);
+
+  std::shared_ptr<const CompiledRegex> regex;
+  Callback on_match;
+  int state = -1;
+  bool matched = false;
+  bool line_done = false; // matched or dead; skip to the newline
+  uint64_t match_end = 0; // valid when matched
+  uint64_t position = 0;
+  uint64_t line = 1;
+  uint64_t line_start = 0;
+};
+
+} // namespace fa::regex
+
+#endif // !SCANNER_HPP
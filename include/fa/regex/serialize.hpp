@@ -0,0 +1,84 @@
+#ifndef SERIALIZE_HPP
+#define SERIALIZE_HPP
+
+#include "compiled.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace fa::regex {
+
+// Bumped whenever the layout below or the meaning of a table changes; files
+// with another version are rejected instead of converted.
+inline constexpr uint32_t COMPILED_FORMAT_VERSION = 7;
+
+// Byte order is the writer's: the tag reads back as 0x01020304 only on a
+// machine with the same endianness, so foreign files are rejected as well.
+inline constexpr uint32_t COMPILED_ENDIAN_TAG = 0x01020304;
+
+// Bits of CompiledHeader::options
+inline constexpr uint32_t COMPILED_IGNORE_CASE = 1u << 0;
+inline constexpr uint32_t COMPILED_WORD_REGEXP = 1u << 1;
+inline constexpr uint32_t COMPILED_LINE_REGEXP = 1u << 2;
+
+// Bits of CompiledHeader::tables: the derived tables present in the file.
+// One left out did not fit CompiledRegex::DERIVED_STATE_BUDGET.
+inline constexpr uint32_t COMPILED_SEARCH_TABLE = 1u << 0;
+inline constexpr uint32_t COMPILED_REVERSE_TABLE = 1u << 1;
+
+// One flat table inside a compiled automaton file
+struct TableHeader {
+  int32_t initial_state;
+  int32_t initial_after_word;
+  int32_t initial_after_non_word;
+  int32_t class_count;
+  int32_t state_count;
+  uint32_t pattern_entries;    // size of the patterns array
+  uint64_t transitions_offset; // int32_t[state_count * class_count]
+  uint64_t accept_offset;      // uint8_t[state_count]
+  // Zero unless the table lists patterns (DFA_View::patterns_of)
+  uint64_t pattern_offsets_offset; // uint32_t[state_count + 1]
+  uint64_t patterns_offset;        // uint32_t[pattern_entries]
+  uint8_t byte_class[256];
+};
+
+/*
+ * On-disk layout of a compiled automaton. The arrays follow the header at
+ * the offsets it records, each one aligned for its element type, so a
+ * mapped file is used in place.
+ */
+struct CompiledHeader {
+  char magic[8]; // "FADFA\0\0\0"
+  uint32_t endian_tag;
+  uint32_t version;
+  uint32_t options; // COMPILED_IGNORE_CASE | ...
+  uint32_t prefix_size;
+  uint64_t prefix_offset; // char[prefix_size]
+  uint64_t file_size;
+  uint32_t pattern_count; // CompiledRegex::pattern_count()
+  uint32_t key_size;
+  uint64_t key_offset; // char[key_size], the key given to save_compiled()
+  uint32_t tables;     // COMPILED_SEARCH_TABLE | COMPILED_REVERSE_TABLE
+  uint32_t reserved;   // zero
+  TableHeader match;   // CompiledRegex::table()
+  TableHeader search;  // CompiledRegex::search_table(), zero if absent
+  TableHeader reverse; // CompiledRegex::reverse_table(), zero if absent
+};
+
+// Writes the three tables, their byte classes, accept masks and pattern
+// lists, the literal prefix and `key` to `path`. The derived tables are
+// built first if they have not been, and left out if they do not fit.
+// Throws std::runtime_error if the file cannot be written.
+void save_compiled(const CompiledRegex &regex, const std::string &path,
+                   const std::string &key = {});
+
+// Maps `path` read-only and returns a matcher that runs on the mapping. The
+// header and the table bounds are checked; std::runtime_error is thrown for
+// a missing, truncated, foreign or corrupt file, or one saved under a key
+// other than `key`.
+std::shared_ptr<const CompiledRegex> load_compiled(const std::string &path,
+                                                   const std::string &key = {});
+
+} // namespace fa::regex
+
+#endif // !SERIALIZE_HPP
@@ -0,0 +1,499 @@
+#ifndef STATIC_REGEX_HPP
+#define STATIC_REGEX_HPP
+
+#include "../automata/dfa_fast.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fa::regex {
+
+// String literal usable as a template argument: static_regex<"ab*">
+template <size_t N> struct fixed_string {
+  char data[N]{};
+
+  constexpr fixed_string(const char (&s)[N]) { std::copy_n(s, N, data); }
+
+  [[nodiscard]] constexpr std::string_view view() const {
+    return {data, N - 1};
+  }
+};
+
+/*
+ * Compile-time counterpart of Parser + Regex::compile(). Everything here
+ * runs in constant evaluation, so it cannot reuse the runtime classes
+ * (std::bitset, std::map and shared_ptr trees are not usable there); it
+ * accepts the syntax of Lexer/Parser except assertions and builds the same
+ * automaton: Thompson NFA, byte classes, subset construction and Moore
+ * minimization.
+ * A syntax error is a throw, which stops compilation of the program.
+ */
+namespace static_detail {
+
+struct ByteSet {
+  std::array<uint64_t, 4> words{};
+
+  constexpr void set(unsigned char b) {
+    words[b >> 6] |= uint64_t(1) << (b & 63);
+  }
+  [[nodiscard]] constexpr bool test(unsigned char b) const {
+    return (words[b >> 6] >> (b & 63)) & 1;
+  }
+  [[nodiscard]] constexpr bool none() const {
+    return (words[0] | words[1] | words[2] | words[3]) == 0;
+  }
+  constexpr void flip() {
+    for (uint64_t &w : words)
+      w = ~w;
+  }
+};
+
+// Thompson state: at most one labelled edge and two epsilon edges
+struct NState {
+  ByteSet label;
+  int next = -1;
+  int eps[2] = {-1, -1};
+};
+
+struct Fragment {
+  int start;
+  int accept;
+};
+
+// Recursive descent over the pattern, emitting Thompson fragments directly
+class Builder {
+private:
+  std::string_view in;
+  size_t pos = 0;
+
+  [[nodiscard]] constexpr char peek(size_t offset = 0) const {
+    return pos + offset < in.size() ? in[pos + offset] : '\0';
+  }
+
+  constexpr int add_state() {
+    states.push_back({});
+    return static_cast<int>(states.size()) - 1;
+  }
+
+  constexpr void add_eps(int from, int to) {
+    NState &s = states[from];
+    (s.eps[0] < 0 ? s.eps[0] : s.eps[1]) = to;
+  }
+
+  constexpr Fragment labelled(const ByteSet &label) {
+    int start = add_state(), accept = add_state();
+    states[start].label = label;
+    states[start].next = accept;
+    return {start, accept};
+  }
+
+  // Same escapes as Lexer::get_escaped_char(); '\0' means "ran out"
+  constexpr char escaped_char() {
+    char c = peek();
+    pos++;
+    if (c != '/')
+      return c;
+    c = peek();
+    if (c == '\0')
+      return '\0';
+    pos++;
+    switch (c) {
+    case 'n':
+      return '\n';
+    case 't':
+      return '\t';
+    case 'r':
+      return '\r';
+    default:
+      return c;
+    }
+  }
+
+  constexpr ByteSet parse_class() {
+    pos++; // '['
+    bool negate = false;
+    if (peek() == '^') {
+      negate = true;
+      pos++;
+    }
+
+    ByteSet bits;
+    if (peek() == ']') {
+      bits.set(']');
+      pos++;
+    }
+    if (peek() == '-') {
+      bits.set('-');
+      pos++;
+    }
+
+    while (peek() != ']' && peek() != '\0') {
+      unsigned char lo = escaped_char();
+      if (lo == '\0')
+        throw std::invalid_argument("static_regex: unterminated escape");
+      if (peek() == '-' && peek(1) != ']' && peek(1) != '\0') {
+        pos++;
+        unsigned char hi = escaped_char();
+        if (hi == '\0')
+          throw std::invalid_argument("static_regex: unterminated escape");
+        for (int b = lo; b <= hi; b++)
+          bits.set(b);
+      } else {
+        bits.set(lo);
+      }
+    }
+
+    if (peek() != ']')
+      throw std::invalid_argument("static_regex: unterminated class");
+    pos++;
+    if (bits.none())
+      throw std::invalid_argument("static_regex: empty class");
+    if (negate)
+      bits.flip();
+    return bits;
+  }
+
+  [[nodiscard]] constexpr bool starts_atom() const {
+    char c = peek();
+    return pos < in.size() && c != '|' && c != ')' && c != '*' && c != '+';
+  }
+
+  constexpr Fragment parse_atom() {
+    if (pos >= in.size())
+      throw std::invalid_argument("static_regex: empty expression");
+
+    char c = peek();
+    if (c == '(') {
+      pos++;
+      Fragment inner = parse_union();
+      if (peek() != ')')
+        throw std::invalid_argument("static_regex: expected ')'");
+      pos++;
+      return inner;
+    }
+    if (c == '[')
+      return labelled(parse_class());
+    if (c == '|' || c == ')' || c == '*' || c == '+')
+      throw std::invalid_argument("static_regex: unexpected operator");
+    if (c == '^' || c == '$' ||
+        (c == '/' && (peek(1) == 'b' || peek(1) == 'B')))
+      throw std::invalid_argument(
+          "static_regex: assertions are not supported");
+
+    char literal = escaped_char();
+    if (literal == '\0')
+      throw std::invalid_argument("static_regex: unterminated escape");
+    ByteSet label;
+    label.set(static_cast<unsigned char>(literal));
+    return labelled(label);
+  }
+
+  constexpr Fragment parse_star() {
+    Fragment expr = parse_atom();
+    while (peek() == '*' || peek() == '+') {
+      bool star = peek() == '*';
+      pos++;
+      int start = add_state(), accept = add_state();
+      add_eps(start, expr.start);
+      add_eps(expr.accept, expr.start);
+      add_eps(expr.accept, accept);
+      if (star)
+        add_eps(start, accept);
+      expr = {start, accept};
+    }
+    return expr;
+  }
+
+  constexpr Fragment parse_concat() {
+    Fragment expr = parse_star();
+    while (starts_atom()) {
+      Fragment next = parse_star();
+      add_eps(expr.accept, next.start);
+      expr.accept = next.accept;
+    }
+    return expr;
+  }
+
+  constexpr Fragment parse_union() {
+    Fragment expr = parse_concat();
+    while (peek() == '|') {
+      pos++;
+      Fragment right = parse_concat();
+      int start = add_state(), accept = add_state();
+      add_eps(start, expr.start);
+      add_eps(start, right.start);
+      add_eps(expr.accept, accept);
+      add_eps(right.accept, accept);
+      expr = {start, accept};
+    }
+    return expr;
+  }
+
+public:
+  std::vector<NState> states;
+
+  constexpr explicit Builder(std::string_view pattern) : in(pattern) {}
+
+  constexpr Fragment build() {
+    Fragment f = parse_union();
+    if (pos != in.size())
+      throw std::invalid_argument(
+          "static_regex: unexpected character at the end of expression");
+    return f;
+  }
+};
+
+// Minimal DFA in DFA_Fast layout, still in growable storage
+struct Table {
+  int initial_state = -1;
+  int class_count = 0;
+  int state_count = 0;
+  std::array<uint8_t, 256> byte_class{};
+  std::vector<int> transitions;
+  std::vector<uint8_t> accept_states;
+};
+
+using Set = std::vector<uint64_t>;
+
+constexpr void closure(const std::vector<NState> &nfa, Set &set) {
+  std::vector<int> stack;
+  for (size_t i = 0; i < nfa.size(); i++)
+    if ((set[i >> 6] >> (i & 63)) & 1)
+      stack.push_back(static_cast<int>(i));
+  while (!stack.empty()) {
+    int s = stack.back();
+    stack.pop_back();
+    for (int t : nfa[s].eps)
+      if (t >= 0 && !((set[t >> 6] >> (t & 63)) & 1)) {
+        set[t >> 6] |= uint64_t(1) << (t & 63);
+        stack.push_back(t);
+      }
+  }
+}
+
+constexpr Table determinize(const std::vector<NState> &nfa, Fragment f) {
+  Table dfa;
+
+  // Byte classes: refine the whole alphabet by every edge label
+  std::array<int, 256> class_of{};
+  int classes = 1;
+  for (const NState &s : nfa) {
+    if (s.next < 0)
+      continue;
+    std::array<int, 512> split{};
+    split.fill(-1);
+    int next_id = 0;
+    for (int b = 0; b < 256; b++) {
+      int key = class_of[b] * 2 + s.label.test(b);
+      if (split[key] < 0)
+        split[key] = next_id++;
+      class_of[b] = split[key];
+    }
+    classes = next_id;
+  }
+  std::vector<int> representative(classes, -1);
+  for (int b = 0; b < 256; b++) {
+    dfa.byte_class[b] = static_cast<uint8_t>(class_of[b]);
+    if (representative[class_of[b]] < 0)
+      representative[class_of[b]] = b;
+  }
+  dfa.class_count = classes;
+
+  const size_t words = (nfa.size() + 63) / 64;
+  std::vector<Set> subsets;
+  Set start(words, 0);
+  start[f.start >> 6] |= uint64_t(1) << (f.start & 63);
+  closure(nfa, start);
+  subsets.push_back(start);
+
+  for (size_t d = 0; d < subsets.size(); d++) {
+    Set current = subsets[d];
+    dfa.accept_states.push_back((current[f.accept >> 6] >> (f.accept & 63)) &
+                                1);
+    for (int c = 0; c < classes; c++) {
+      Set moved(words, 0);
+      bool any = false;
+      for (size_t s = 0; s < nfa.size(); s++)
+        if (((current[s >> 6] >> (s & 63)) & 1) && nfa[s].next >= 0 &&
+            nfa[s].label.test(representative[c])) {
+          int t = nfa[s].next;
+          moved[t >> 6] |= uint64_t(1) << (t & 63);
+          any = true;
+        }
+      if (!any) {
+        dfa.transitions.push_back(-1);
+        continue;
+      }
+      closure(nfa, moved);
+      size_t id = 0;
+      while (id < subsets.size() && subsets[id] != moved)
+        id++;
+      if (id == subsets.size())
+        subsets.push_back(moved);
+      dfa.transitions.push_back(static_cast<int>(id));
+    }
+  }
+
+  dfa.initial_state = 0;
+  dfa.state_count = static_cast<int>(subsets.size());
+  return dfa;
+}
+
+// Moore refinement with an explicit dead sink, as DFA_Fast::minimize()
+constexpr Table minimize(const Table &dfa) {
+  const int n = dfa.state_count, k = dfa.class_count, dead = n;
+  auto target = [&](int s, int c) {
+    if (s == dead)
+      return dead;
+    int t = dfa.transitions[s * k + c];
+    return t < 0 ? dead : t;
+  };
+
+  std::vector<int> block(n + 1, 0);
+  for (int s = 0; s < n; s++)
+    block[s] = dfa.accept_states[s];
+  size_t n_blocks = 0;
+
+  while (true) {
+    std::vector<std::vector<int>> signatures;
+    std::vector<int> refined(n + 1);
+    for (int s = 0; s <= n; s++) {
+      std::vector<int> sig{block[s]};
+      for (int c = 0; c < k; c++)
+        sig.push_back(block[target(s, c)]);
+      size_t id = 0;
+      while (id < signatures.size() && signatures[id] != sig)
+        id++;
+      if (id == signatures.size())
+        signatures.push_back(sig);
+      refined[s] = static_cast<int>(id);
+    }
+    bool stable = signatures.size() == n_blocks;
+    n_blocks = signatures.size();
+    block = refined;
+    if (stable)
+      break;
+  }
+
+  Table min;
+  min.class_count = k;
+  min.byte_class = dfa.byte_class;
+  const int dead_block = block[dead];
+  if (block[dfa.initial_state] == dead_block)
+    return min;
+
+  std::vector<int> representative(n_blocks, -1);
+  for (int s = 0; s < n; s++)
+    if (representative[block[s]] < 0)
+      representative[block[s]] = s;
+
+  // Breadth-first renumbering from the initial state
+  std::vector<int> new_id(n_blocks, -1);
+  std::vector<int> order{block[dfa.initial_state]};
+  new_id[order[0]] = 0;
+  for (size_t i = 0; i < order.size(); i++)
+    for (int c = 0; c < k; c++) {
+      int tb = block[target(representative[order[i]], c)];
+      if (tb != dead_block && new_id[tb] < 0) {
+        new_id[tb] = static_cast<int>(order.size());
+        order.push_back(tb);
+      }
+    }
+
+  min.initial_state = 0;
+  min.state_count = static_cast<int>(order.size());
+  for (int b : order) {
+    int rep = representative[b];
+    min.accept_states.push_back(dfa.accept_states[rep]);
+    for (int c = 0; c < k; c++) {
+      int tb = block[target(rep, c)];
+      min.transitions.push_back(tb == dead_block ? -1 : new_id[tb]);
+    }
+  }
+  return min;
+}
+
+constexpr Table compile(std::string_view pattern) {
+  Builder builder(pattern);
+  Fragment f = builder.build();
+  return minimize(determinize(builder.states, f));
+}
+
+// The same table in fixed-size arrays, so it can live in a constexpr
+// variable (and therefore in .rodata)
+template <int States, int Classes> struct FixedTable {
+  int initial_state = -1;
+  std::array<uint8_t, 256> byte_class{};
+  std::array<int, States * Classes> transitions{};
+  std::array<uint8_t, States> accept_states{};
+};
+
+} // namespace static_detail
+
+/*
+ * Pattern compiled to a minimal DFA while the program is compiled, e.g.
+ *
+ *   using log_prefix = fa::regex::static_regex<"[A-Z]+: [0-9]+">;
+ *   static_assert(log_prefix::match("ERR: 42"));
+ *
+ * match() is a constexpr loop over constant tables, with no runtime
+ * compilation and nothing allocated.
+ */
+template <fixed_string Pattern> class static_regex {
+private:
+  static constexpr auto dims = [] {
+    static_detail::Table t = static_detail::compile(Pattern.view());
+    return std::pair{t.state_count, t.class_count};
+  }();
+
+public:
+  static constexpr int state_count = dims.first;
+  static constexpr int class_count = dims.second;
+
+  static constexpr auto table = [] {
+    static_detail::Table t = static_detail::compile(Pattern.view());
+    static_detail::FixedTable<state_count, class_count> fixed;
+    fixed.initial_state = t.initial_state;
+    fixed.byte_class = t.byte_class;
+    std::copy(t.transitions.begin(), t.transitions.end(),
+              fixed.transitions.begin());
+    std::copy(t.accept_states.begin(), t.accept_states.end(),
+              fixed.accept_states.begin());
+    return fixed;
+  }();
+
+  [[nodiscard]] static constexpr bool match(std::string_view word) {
+    int state = table.initial_state;
+    if (state < 0)
+      return false;
+    for (unsigned char symbol : word) {
+      state = table.transitions[state * class_count + table.byte_class[symbol]];
+      if (state < 0)
+        return false;
+    }
+    return table.accept_states[state];
+  }
+
+  // Runtime copy, e.g. to hand the automaton to CompiledRegex
+  [[nodiscard]] static DFA_Fast to_fast() {
+    DFA_Fast dfa;
+    dfa.initial_state = table.initial_state;
+    dfa.initial_after_word = table.initial_state;
+    dfa.initial_after_non_word = table.initial_state;
+    dfa.class_count = class_count;
+    dfa.byte_class = table.byte_class;
+    dfa.transitions.assign(table.transitions.begin(), table.transitions.end());
+    for (uint8_t accept : table.accept_states)
+      dfa.accept_states.push_back(accept ? ACCEPT_ALWAYS : 0);
+    return dfa;
+  }
+};
+
+} // namespace fa::regex
+
+#endif // !STATIC_REGEX_HPP
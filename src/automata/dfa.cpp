@@ -7,6 +7,19 @@
 
 using namespace std;
 
+void DFA::set_byte_classes(const ByteClasses &byte_classes) {
+  classes = byte_classes;
+}
+
+ByteClasses DFA::byte_classes() const {
+  if (classes.count() > 0)
+    return classes;
+  ByteClasses singletons;
+  for (char s : alphabet)
+    singletons.refine(s);
+  return singletons;
+}
+
 unique_ptr<DFA> DFA::minimize(void) {
   if (!initial_state.has_value() || states.empty())
     return make_unique<DFA>(*this);
@@ -22,7 +35,11 @@ unique_ptr<DFA> DFA::minimize(void) {
   if (!no_finals.empty())
     partitions.push_back(no_finals);
 
-  vector<char> symbols(alphabet.begin(), alphabet.end());
+  // Refinement only needs one representative symbol per byte class
+  const ByteClasses byte_cls = byte_classes();
+  vector<char> symbols;
+  for (int c = 0; c < byte_cls.count(); c++)
+    symbols.push_back(byte_cls.representative(c));
   map<string, int> block_of;
 
   while (true) {
@@ -50,9 +67,15 @@ unique_ptr<DFA> DFA::minimize(void) {
     partitions = move(new_partitions);
   }
 
-  // block_of ya tiene el resultado final, no hay que reconstruirlo
-  auto block_name = [](int i) { return "B" + to_string(i); };
+  // block_of ya tiene el resultado final. Los bloques se nombran q0..qn-1
+  // con el bloque inicial primero, así no hace falta normalize_states()
+  const int initial_block = block_of[initial_state.value()];
+  auto block_name = [&](int i) {
+    int id = (i == initial_block) ? 0 : (i < initial_block ? i + 1 : i);
+    return "q" + to_string(id);
+  };
   auto min_dfa = make_unique<DFA>();
+  min_dfa->set_byte_classes(byte_cls);
 
   for (size_t i = 0; i < partitions.size(); i++) {
     bool is_final =
@@ -61,15 +84,16 @@ unique_ptr<DFA> DFA::minimize(void) {
     min_dfa->add_state(block_name(i), is_final);
   }
 
-  min_dfa->mark_initial_state(block_name(block_of[initial_state.value()]));
+  min_dfa->mark_initial_state(block_name(initial_block));
 
   for (size_t i = 0; i < partitions.size(); i++) {
     const string &rep = *partitions[i].begin();
-    for (char a : symbols)
-      min_dfa->add_transition(block_name(i), a,
-                              block_name(block_of[transitions[rep][a]]));
+    for (int c = 0; c < byte_cls.count(); c++) {
+      string target = block_name(block_of[transitions[rep][symbols[c]]]);
+      for (char a : byte_cls.members(c))
+        min_dfa->add_transition(block_name(i), a, target);
+    }
   }
 
-  min_dfa->normalize_states();
   return min_dfa;
 }
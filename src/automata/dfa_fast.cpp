@@ -0,0 +1,375 @@
+#include "../../include/fa/automata/dfa_fast.hpp"
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+DFA_Fast DFA_Fast::minimize() const {
+  const int roots[3] = {initial_state, initial_after_word,
+                        initial_after_non_word};
+  if (roots[0] < 0 && roots[1] < 0 && roots[2] < 0)
+    return *this;
+
+  const int n = size();
+  const int dead = n; // implicit sink, made explicit for the refinement
+  auto target = [&](int s, int c) {
+    if (s == dead)
+      return dead;
+    int t = transitions[s * class_count + c];
+    return t < 0 ? dead : t;
+  };
+
+  vector<int> block(n + 1);
+  if (has_patterns()) {
+    // Accepting states of a pattern set start out apart unless they list
+    // the same patterns; the dead state lists none
+    map<vector<uint32_t>, int> first_blocks{{{0}, 0}};
+    for (int s = 0; s < n; s++) {
+      vector<uint32_t> key{accept_states[s]};
+      ranges::copy(patterns_of(s), back_inserter(key));
+      block[s] = first_blocks.emplace(key, static_cast<int>(first_blocks.size()))
+                     .first->second;
+    }
+  } else {
+    for (int s = 0; s < n; s++)
+      block[s] = accept_states[s];
+  }
+  block[dead] = 0;
+  size_t n_blocks = 0;
+
+  while (true) {
+    map<vector<int>, int> signatures;
+    vector<int> refined(n + 1);
+    vector<int> sig(class_count + 1);
+    for (int s = 0; s <= n; s++) {
+      sig[0] = block[s];
+      for (int c = 0; c < class_count; c++)
+        sig[c + 1] = block[target(s, c)];
+      refined[s] =
+          signatures.emplace(sig, static_cast<int>(signatures.size()))
+              .first->second;
+    }
+
+    bool stable = signatures.size() == n_blocks;
+    n_blocks = signatures.size();
+    block = move(refined);
+    if (stable)
+      break;
+  }
+
+  DFA_Fast min;
+  min.class_count = class_count;
+  min.byte_class = byte_class;
+
+  const int dead_block = block[dead];
+  vector<int> representative(n_blocks, -1);
+  for (int s = 0; s < n; s++)
+    if (representative[block[s]] < 0)
+      representative[block[s]] = s;
+
+  // Breadth-first from the initial states; `order` doubles as the queue
+  vector<int> new_id(n_blocks, -1);
+  vector<int> order;
+  auto visit = [&](int b) {
+    if (b == dead_block || new_id[b] >= 0)
+      return;
+    new_id[b] = static_cast<int>(order.size());
+    order.push_back(b);
+  };
+  for (int root : roots)
+    if (root >= 0)
+      visit(block[root]);
+  for (size_t i = 0; i < order.size(); i++)
+    for (int c = 0; c < class_count; c++)
+      visit(block[target(representative[order[i]], c)]);
+
+  if (order.empty())
+    return min;
+
+  auto root_id = [&](int root) { return root < 0 ? -1 : new_id[block[root]]; };
+  min.initial_state = root_id(roots[0]);
+  min.initial_after_word = root_id(roots[1]);
+  min.initial_after_non_word = root_id(roots[2]);
+  min.transitions.assign(order.size() * class_count, -1);
+  min.accept_states.assign(order.size(), 0);
+  if (has_patterns())
+    min.pattern_offsets.push_back(0);
+  for (size_t i = 0; i < order.size(); i++) {
+    int rep = representative[order[i]];
+    min.accept_states[i] = accept_states[rep];
+    if (has_patterns()) {
+      ranges::copy(patterns_of(rep), back_inserter(min.patterns));
+      min.pattern_offsets.push_back(static_cast<uint32_t>(min.patterns.size()));
+    }
+    for (int c = 0; c < class_count; c++) {
+      int tb = block[target(rep, c)];
+      min.transitions[i * class_count + c] =
+          (tb == dead_block) ? -1 : new_id[tb];
+    }
+  }
+
+  return min;
+}
+
+/* Every byte of a column has the same context whenever it matters, since
+   assertions split the word bytes into classes of their own */
+static vector<Context> column_contexts(const DFA_Fast &dfa) {
+  vector<Context> column_context(dfa.class_count, CONTEXT_NON_WORD);
+  for (int b = 255; b >= 0; b--)
+    column_context[dfa.byte_class[b]] = context_of(b);
+  return column_context;
+}
+
+DFA_Fast DFA_Fast::unanchored(size_t max_states) const {
+  DFA_Fast search;
+  search.class_count = class_count;
+  search.byte_class = byte_class;
+  const vector<Context> column_context = column_contexts(*this);
+
+  // The empty subset is kept: a match may still start after a later byte.
+  // If none can, minimize() finds it equivalent to the dead state.
+  map<vector<int>, int> state_of;
+  vector<vector<int>> subsets;
+  auto add = [&](vector<int> subset) {
+    sort(subset.begin(), subset.end());
+    subset.erase(unique(subset.begin(), subset.end()), subset.end());
+    auto [it, inserted] =
+        state_of.emplace(subset, static_cast<int>(subsets.size()));
+    if (inserted) {
+      if (max_states && subsets.size() == max_states)
+        throw length_error("DFA state budget exceeded");
+      subsets.push_back(subset);
+    }
+    return it->second;
+  };
+  auto root = [&](int start) {
+    return add(start < 0 ? vector<int>{} : vector<int>{start});
+  };
+
+  search.initial_state = root(initial_state);
+  search.initial_after_word = root(initial_after_word);
+  search.initial_after_non_word = root(initial_after_non_word);
+  if (has_patterns())
+    search.pattern_offsets.push_back(0);
+
+  for (size_t i = 0; i < subsets.size(); i++) {
+    const vector<int> current = subsets[i];
+    uint8_t accept = 0;
+    for (int s : current)
+      accept |= accept_states[s];
+    search.accept_states.push_back(accept);
+
+    if (has_patterns()) {
+      map<uint32_t, uint8_t> masks; // pattern id -> contexts it accepts
+      for (int s : current)
+        for (uint32_t entry : patterns_of(s))
+          masks[entry_pattern(entry)] |= entry & ACCEPT_ALWAYS;
+      for (auto [id, mask] : masks)
+        search.patterns.push_back(pattern_entry(id, mask));
+      search.pattern_offsets.push_back(
+          static_cast<uint32_t>(search.patterns.size()));
+    }
+
+    search.transitions.resize((i + 1) * class_count, -1);
+    for (int c = 0; c < class_count; c++) {
+      vector<int> moved;
+      for (int s : current)
+        if (int t = transitions[s * class_count + c]; t >= 0)
+          moved.push_back(t);
+      // A new match may start right after this byte
+      if (int start = initial(column_context[c]); start >= 0)
+        moved.push_back(start);
+      search.transitions[i * class_count + c] = add(move(moved));
+    }
+  }
+
+  return search.minimize();
+}
+
+DFA_Fast DFA_Fast::reversed(size_t max_states) const {
+  DFA_Fast reverse;
+  reverse.class_count = class_count;
+  reverse.byte_class = byte_class;
+  // A pattern such as '/Ba' only starts after a byte
+  if (initial_state < 0 && initial_after_word < 0 &&
+      initial_after_non_word < 0)
+    return reverse;
+
+  const int n = size();
+  const vector<Context> column_context = column_contexts(*this);
+
+  // Predecessors per column: sources[c][t] are the states reaching t on c
+  vector<vector<vector<int>>> sources(class_count, vector<vector<int>>(n));
+  for (int s = 0; s < n; s++)
+    for (int c = 0; c < class_count; c++)
+      if (int t = transitions[s * class_count + c]; t >= 0)
+        sources[c][t].push_back(s);
+
+  // States that end a match right before a byte of context `next`
+  auto accepting = [&](Context next) {
+    vector<bool> set(n);
+    for (int s = 0; s < n; s++)
+      set[s] = accepts(s, next);
+    return set;
+  };
+
+  map<vector<bool>, int> state_of;
+  vector<vector<bool>> subsets;
+  auto add = [&](vector<bool> subset) {
+    auto [it, inserted] =
+        state_of.emplace(subset, static_cast<int>(subsets.size()));
+    if (inserted) {
+      if (max_states && subsets.size() == max_states)
+        throw length_error("DFA state budget exceeded");
+      subsets.push_back(move(subset));
+    }
+    return it->second;
+  };
+
+  reverse.initial_state = add(accepting(CONTEXT_EDGE));
+  reverse.initial_after_word = add(accepting(CONTEXT_WORD));
+  reverse.initial_after_non_word = add(accepting(CONTEXT_NON_WORD));
+
+  const int starts[3] = {initial_state, initial_after_word,
+                         initial_after_non_word};
+  for (size_t i = 0; i < subsets.size(); i++) {
+    const vector<bool> current = subsets[i];
+    uint8_t accept = 0;
+    for (Context prev : {CONTEXT_EDGE, CONTEXT_WORD, CONTEXT_NON_WORD})
+      if (starts[prev] >= 0 && current[starts[prev]])
+        accept |= accept_bit(prev);
+    reverse.accept_states.push_back(accept);
+
+    // Before byte b: a match may end right there, or b leads into the set
+    reverse.transitions.resize((i + 1) * class_count, -1);
+    for (int c = 0; c < class_count; c++) {
+      vector<bool> moved = accepting(column_context[c]);
+      for (int t = 0; t < n; t++)
+        if (current[t])
+          for (int s : sources[c][t])
+            moved[s] = true;
+      reverse.transitions[i * class_count + c] = add(move(moved));
+    }
+  }
+
+  return reverse.minimize();
+}
+
+DFA_Fast DFA_Fast::from_view(const DFA_View &view) {
+  DFA_Fast dfa;
+  dfa.initial_state = view.initial_state;
+  dfa.initial_after_word = view.initial_after_word;
+  dfa.initial_after_non_word = view.initial_after_non_word;
+  dfa.class_count = view.class_count;
+  copy(view.byte_class, view.byte_class + 256, dfa.byte_class.begin());
+  dfa.transitions.assign(view.transitions,
+                         view.transitions + view.state_count * view.class_count);
+  dfa.accept_states.assign(view.accept_states,
+                           view.accept_states + view.state_count);
+  if (view.has_patterns()) {
+    dfa.pattern_offsets.assign(view.pattern_offsets,
+                               view.pattern_offsets + view.state_count + 1);
+    dfa.patterns.assign(view.patterns,
+                        view.patterns + view.pattern_offsets[view.state_count]);
+  }
+  return dfa;
+}
+
+DFA_Fast DFA_Fast::containing() const {
+  DFA_Fast result;
+  result.class_count = class_count;
+  result.byte_class = byte_class;
+  result.initial_state = initial_state;
+  result.initial_after_word = initial_after_word;
+  result.initial_after_non_word = initial_after_non_word;
+  const vector<Context> column_context = column_contexts(*this);
+
+  const int n = size();
+  const int matched = n; // absorbing, accepts everything after a match
+  result.transitions.assign((n + 1) * class_count, matched);
+  result.accept_states.assign(n + 1, ACCEPT_ALWAYS);
+  for (int s = 0; s < n; s++) {
+    if (!accepts(s, CONTEXT_EDGE))
+      result.accept_states[s] = 0;
+    for (int c = 0; c < class_count; c++)
+      if (!accepts(s, column_context[c]))
+        result.transitions[s * class_count + c] =
+            transitions[s * class_count + c];
+  }
+  return result.minimize();
+}
+
+DFA_Fast DFA_Fast::complement() const {
+  DFA_Fast result;
+  result.class_count = max(class_count, 1);
+  result.byte_class = byte_class;
+
+  const int n = size();
+  const int sink = n; // stands for every missing transition
+  auto total = [&](int state) { return state < 0 ? sink : state; };
+  result.initial_state = total(initial_state);
+  result.initial_after_word = total(initial_after_word);
+  result.initial_after_non_word = total(initial_after_non_word);
+
+  result.transitions.assign((n + 1) * result.class_count, sink);
+  result.accept_states.assign(n + 1, ACCEPT_ALWAYS);
+  for (int s = 0; s < n; s++) {
+    result.accept_states[s] = ~accept_states[s] & ACCEPT_ALWAYS;
+    for (int c = 0; c < class_count; c++)
+      result.transitions[s * result.class_count + c] =
+          total(transitions[s * class_count + c]);
+  }
+  return result.minimize();
+}
+
+DFA_Fast DFA_Fast::intersect(const DFA_Fast &other) const {
+  DFA_Fast product;
+
+  // One column per pair of classes that some byte falls into
+  map<pair<int, int>, int> column_of;
+  vector<pair<int, int>> columns;
+  for (int b = 0; b < 256; b++) {
+    pair<int, int> key(byte_class[b], other.byte_class[b]);
+    auto [it, inserted] =
+        column_of.emplace(key, static_cast<int>(columns.size()));
+    if (inserted)
+      columns.push_back(key);
+    product.byte_class[b] = static_cast<uint8_t>(it->second);
+  }
+  product.class_count = static_cast<int>(columns.size());
+
+  map<pair<int, int>, int> state_of;
+  vector<pair<int, int>> pairs;
+  auto add = [&](int a, int b) {
+    if (a < 0 || b < 0)
+      return -1;
+    auto [it, inserted] =
+        state_of.emplace(pair(a, b), static_cast<int>(pairs.size()));
+    if (inserted)
+      pairs.emplace_back(a, b);
+    return it->second;
+  };
+  product.initial_state = add(initial_state, other.initial_state);
+  product.initial_after_word =
+      add(initial_after_word, other.initial_after_word);
+  product.initial_after_non_word =
+      add(initial_after_non_word, other.initial_after_non_word);
+
+  for (size_t i = 0; i < pairs.size(); i++) {
+    const auto [a, b] = pairs[i];
+    product.accept_states.push_back(accept_states[a] &
+                                    other.accept_states[b]);
+    product.transitions.resize((i + 1) * product.class_count, -1);
+    for (int c = 0; c < product.class_count; c++) {
+      const auto [ca, cb] = columns[c];
+      product.transitions[i * product.class_count + c] =
+          add(transitions[a * class_count + ca],
+              other.transitions[b * other.class_count + cb]);
+    }
+  }
+  return product.minimize();
+}
@@ -1,115 +1,404 @@
 #include "../../include/fa/automata/ndfa.hpp"
 #include "../../include/fa/automata/dfa.hpp"
+#include <algorithm>
+#include <bitset>
+#include <format>
 #include <map>
 #include <memory>
-#include <queue>
+#include <set>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
-set<string> NDFA::epsilon_closure(const set<string> &states) const {
-  set<string> closure(states);
-  queue<string> to_process;
-  for (const auto &s : states)
-    to_process.push(s);
-
-  while (!to_process.empty()) {
-    string current = to_process.front();
-    to_process.pop();
-    auto state_it = transitions.find(current);
-    if (state_it == transitions.end())
-      continue;
-    auto symbol_it = state_it->second.find(EPSILON);
-    if (symbol_it == state_it->second.end())
-      continue;
-    for (const auto &next : symbol_it->second)
-      if (closure.insert(next).second)
-        to_process.push(next);
+void NDFA::add_class_transition(const string &from, const bitset<256> &symbols,
+                                const string &to) {
+  if (!states.contains(from) || !states.contains(to) || symbols.none())
+    return;
+  class_transitions[from].emplace_back(symbols, to);
+}
+
+void NDFA::add_assertion_transition(const string &from, Assertion assertion,
+                                    const string &to) {
+  if (!states.contains(from) || !states.contains(to))
+    return;
+  assertion_transitions[from].emplace_back(assertion, to);
+}
+
+void NDFA::tag_final_state(const string &state, uint32_t pattern) {
+  if (!final_states.contains(state))
+    return;
+  final_patterns[state] = pattern;
+}
+
+void NDFA::rename_states(const map<string, string> &new_names) {
+  FA::rename_states(new_names);
+
+  map<string, vector<pair<bitset<256>, string>>> renamed_classes;
+  for (const auto &[from, edges] : class_transitions) {
+    auto &row = renamed_classes[renamed(new_names, from)];
+    for (const auto &[symbols, to] : edges)
+      row.emplace_back(symbols, renamed(new_names, to));
+  }
+
+  map<string, vector<pair<Assertion, string>>> renamed_assertions;
+  for (const auto &[from, edges] : assertion_transitions) {
+    auto &row = renamed_assertions[renamed(new_names, from)];
+    for (const auto &[assertion, to] : edges)
+      row.emplace_back(assertion, renamed(new_names, to));
   }
-  return closure;
+
+  map<string, uint32_t> renamed_patterns;
+  for (const auto &[state, pattern] : final_patterns)
+    renamed_patterns[renamed(new_names, state)] = pattern;
+
+  class_transitions = move(renamed_classes);
+  assertion_transitions = move(renamed_assertions);
+  final_patterns = move(renamed_patterns);
 }
 
-set<string> NDFA::epsilon_closure(const string &state) const {
-  return epsilon_closure(set<string>{state});
+bool assertion_holds(Assertion a, Context prev, Context next) {
+  bool word_before = prev == CONTEXT_WORD;
+  bool word_after = next == CONTEXT_WORD;
+  switch (a) {
+  case Assertion::LINE_START:
+    return prev == CONTEXT_EDGE;
+  case Assertion::LINE_END:
+    return next == CONTEXT_EDGE;
+  case Assertion::WORD_BOUNDARY:
+    return word_before != word_after;
+  case Assertion::NOT_WORD_BOUNDARY:
+    return word_before == word_after;
+  case Assertion::NOT_AFTER_WORD:
+    return !word_before;
+  case Assertion::NOT_BEFORE_WORD:
+    return !word_after;
+  }
+  return false;
 }
 
-set<string> NDFA::move(const set<string> &states, char symbol) const {
-  set<string> result;
-  for (const auto &state : states) {
-    auto state_it = transitions.find(state);
-    if (state_it == transitions.end())
-      continue;
-    auto symbol_it = state_it->second.find(symbol);
-    if (symbol_it == state_it->second.end())
+static string describe_assertion(Assertion a) {
+  switch (a) {
+  case Assertion::LINE_START:
+    return "^";
+  case Assertion::LINE_END:
+    return "$";
+  case Assertion::WORD_BOUNDARY:
+    return "/b";
+  case Assertion::NOT_WORD_BOUNDARY:
+    return "/B";
+  case Assertion::NOT_AFTER_WORD:
+    return "<";
+  case Assertion::NOT_BEFORE_WORD:
+    return ">";
+  }
+  return "?";
+}
+
+static string describe_class(const bitset<256> &symbols) {
+  auto printable = [](int c) {
+    if (c >= 33 && c <= 126)
+      return string(1, static_cast<char>(c));
+    return "\\x" + format("{:02x}", c);
+  };
+
+  string s = "[";
+  for (int i = 0; i < 256; i++) {
+    if (!symbols.test(i))
       continue;
-    result.insert(symbol_it->second.begin(), symbol_it->second.end());
+    int j = i;
+    while (j + 1 < 256 && symbols.test(j + 1))
+      j++;
+    s += printable(i);
+    if (j > i)
+      s += "-" + printable(j);
+    i = j;
   }
+  return s + "]";
+}
+
+string NDFA::transitions_table() const {
+  stringstream ss;
+  ss << FA<set<string>>::transitions_table();
+  for (const auto &[from, edges] : class_transitions)
+    for (const auto &[symbols, to] : edges)
+      ss << from << " --" << describe_class(symbols) << "--> " << to << "\n";
+  for (const auto &[from, edges] : assertion_transitions)
+    for (const auto &[assertion, to] : edges)
+      ss << from << " --" << describe_assertion(assertion) << "--> " << to
+         << "\n";
+  return ss.str();
+}
+
+StateSet NDFAIndex::closure(const StateSet &states) const {
+  StateSet result(names.size());
+  states.for_each([&](size_t s) { result |= closures[s]; });
   return result;
 }
 
-unique_ptr<DFA> NDFA::determinize() const {
-  if (!initial_state.has_value())
-    throw invalid_argument("NDFA initial state is not set");
+StateSet NDFAIndex::resolve(const StateSet &states, Context prev,
+                            Context next) const {
+  StateSet result = states;
+  if (!has_assertions)
+    return result;
+
+  vector<int> pending;
+  states.for_each([&](size_t s) { pending.push_back(static_cast<int>(s)); });
+  while (!pending.empty()) {
+    int s = pending.back();
+    pending.pop_back();
+    for (const auto &[assertion, target] : assertions[s]) {
+      if (result.contains(target) || !assertion_holds(assertion, prev, next))
+        continue;
+      closures[target].for_each([&](size_t t) {
+        if (!result.contains(t)) {
+          result.insert(t);
+          pending.push_back(static_cast<int>(t));
+        }
+      });
+    }
+  }
+  return result;
+}
+
+NDFAIndex NDFA::index() const {
+  NDFAIndex idx;
+  const size_t n = states.size();
 
-  set<char> alphabet_clean;
+  map<string, int> id_of;
+  idx.names.reserve(n);
+  for (const auto &state : states) {
+    id_of[state] = static_cast<int>(idx.names.size());
+    idx.names.push_back(state);
+  }
+  if (initial_state.has_value())
+    idx.initial = id_of.at(initial_state.value());
+
+  idx.finals = StateSet(n);
+  for (const auto &state : final_states)
+    idx.finals.insert(id_of.at(state));
+
+  // Refine once per distinct label: single symbols and whole classes
   for (char s : alphabet)
     if (s != EPSILON)
-      alphabet_clean.insert(s);
+      idx.classes.refine(s);
+  vector<bitset<256>> labels;
+  for (const auto &[_, edges] : class_transitions)
+    for (const auto &[symbols, to] : edges)
+      if (find(labels.begin(), labels.end(), symbols) == labels.end()) {
+        labels.push_back(symbols);
+        idx.classes.refine(symbols);
+      }
+  // Assertions look at the byte just read, so no class may mix word and
+  // non-word bytes
+  idx.has_assertions = !assertion_transitions.empty();
+  if (idx.has_assertions) {
+    bitset<256> word;
+    for (int b = 0; b < 256; b++)
+      word[b] = is_word_byte(static_cast<unsigned char>(b));
+    idx.classes.refine(word);
+  }
 
-  auto dfa = make_unique<DFA>();
-  map<set<string>, string> state_mapping;
-  queue<set<string>> to_process;
-  int counter = 0;
-
-  auto new_dfa_state = [&](const set<string> &ndfa_set) -> string {
-    string name = "q" + to_string(counter++);
-    dfa->add_state(name);
-    state_mapping[ndfa_set] = name;
-    to_process.push(ndfa_set);
-    return name;
+  vector<vector<int>> eps(n);
+  idx.edges.assign(n, {});
+  for (const auto &[state, symbol_map] : transitions) {
+    int from = id_of.at(state);
+    for (const auto &[symbol, targets] : symbol_map)
+      for (const auto &to : targets) {
+        if (symbol == EPSILON)
+          eps[from].push_back(id_of.at(to));
+        else
+          idx.edges[from].emplace_back(
+              idx.classes.class_of_byte(static_cast<unsigned char>(symbol)),
+              id_of.at(to));
+      }
+  }
+  for (const auto &[state, edges] : class_transitions) {
+    int from = id_of.at(state);
+    for (const auto &[symbols, to] : edges)
+      for (int c = 0; c < idx.classes.count(); c++)
+        if (symbols.test(static_cast<unsigned char>(idx.classes.representative(c))))
+          idx.edges[from].emplace_back(c, id_of.at(to));
+  }
+  idx.final_pattern.assign(n, -1);
+  for (const auto &[state, pattern] : final_patterns)
+    idx.final_pattern[id_of.at(state)] = pattern;
+  idx.has_patterns = !final_patterns.empty();
+
+  idx.assertions.assign(n, {});
+  for (const auto &[state, edges] : assertion_transitions)
+    for (const auto &[assertion, to] : edges)
+      idx.assertions[id_of.at(state)].emplace_back(assertion, id_of.at(to));
+
+  idx.closures.assign(n, StateSet(n));
+  vector<int> stack;
+  for (size_t s = 0; s < n; s++) {
+    StateSet &closure = idx.closures[s];
+    closure.insert(s);
+    stack.push_back(static_cast<int>(s));
+    while (!stack.empty()) {
+      int current = stack.back();
+      stack.pop_back();
+      for (int next : eps[current])
+        if (!closure.contains(next)) {
+          closure.insert(next);
+          stack.push_back(next);
+        }
+    }
+  }
+
+  return idx;
+}
+
+DFA_Fast NDFA::subset_construction(const NDFAIndex &idx,
+                                   size_t max_states) const {
+  const size_t n = idx.names.size();
+  const int n_classes = idx.classes.count();
+
+  DFA_Fast fast;
+  bool has_dead_bytes = false;
+  for (int b = 0; b < 256; b++) {
+    int cls = idx.classes.class_of_byte(b);
+    has_dead_bytes = has_dead_bytes || cls < 0;
+    fast.byte_class[b] = static_cast<uint8_t>(cls < 0 ? n_classes : cls);
+  }
+  fast.class_count = n_classes + (has_dead_bytes ? 1 : 0);
+
+  // Column contexts for the byte just read; uniform per class once the
+  // word bytes have been split off
+  vector<Context> column_context(fast.class_count, CONTEXT_NON_WORD);
+  for (int b = 255; b >= 0; b--)
+    column_context[fast.byte_class[b]] = context_of(b);
+
+  // With assertions a state also remembers what came before it, since that
+  // decides which assertion edges may be taken
+  using Key = pair<StateSet, Context>;
+  struct KeyHash {
+    size_t operator()(const Key &k) const {
+      return StateSetHash{}(k.first) * 3 + k.second;
+    }
+  };
+  unordered_map<Key, int, KeyHash> state_mapping;
+  vector<Key> subsets;
+  auto state_of = [&](const StateSet &ndfa_set, Context prev) {
+    Key key(ndfa_set, idx.has_assertions ? prev : CONTEXT_EDGE);
+    auto [it, inserted] =
+        state_mapping.emplace(key, static_cast<int>(subsets.size()));
+    if (inserted) {
+      if (max_states && subsets.size() == max_states)
+        throw length_error("DFA state budget exceeded");
+      subsets.push_back(key);
+    }
+    return it->second;
   };
 
-  set<string> initial_set = epsilon_closure(initial_state.value());
-  string dfa_initial = new_dfa_state(initial_set);
-  dfa->mark_initial_state(dfa_initial);
+  const StateSet &start = idx.closures[idx.initial];
+  fast.initial_state = state_of(start, CONTEXT_EDGE);
+  fast.initial_after_word = state_of(start, CONTEXT_WORD);
+  fast.initial_after_non_word = state_of(start, CONTEXT_NON_WORD);
 
-  while (!to_process.empty()) {
-    set<string> current_set = to_process.front();
-    to_process.pop();
-    const string &current_name = state_mapping[current_set];
+  if (idx.has_patterns)
+    fast.pattern_offsets.push_back(0);
 
-    for (const auto &s : current_set)
-      if (final_states.contains(s)) {
-        dfa->mark_final_state(current_name);
-        break;
-      }
+  vector<StateSet> next_sets;
+  map<uint32_t, uint8_t> pattern_masks;
+  for (size_t i = 0; i < subsets.size(); i++) {
+    const auto [current_set, prev] = subsets[i];
 
-    for (char symbol : alphabet_clean) {
-      set<string> next_set = epsilon_closure(move(current_set, symbol));
-      if (next_set.empty())
-        continue;
-      if (!state_mapping.contains(next_set))
-        new_dfa_state(next_set);
-      dfa->add_transition(current_name, symbol, state_mapping[next_set]);
+    uint8_t accept = 0;
+    pattern_masks.clear();
+    for (Context next : {CONTEXT_EDGE, CONTEXT_WORD, CONTEXT_NON_WORD}) {
+      StateSet resolved = idx.resolve(current_set, prev, next);
+      if (resolved.intersects(idx.finals))
+        accept |= accept_bit(next);
+      if (idx.has_patterns)
+        resolved.for_each([&](size_t s) {
+          if (idx.final_pattern[s] >= 0)
+            pattern_masks[idx.final_pattern[s]] |= accept_bit(next);
+        });
+    }
+    fast.accept_states.push_back(accept);
+    if (idx.has_patterns) {
+      for (auto [id, mask] : pattern_masks)
+        fast.patterns.push_back(pattern_entry(id, mask));
+      fast.pattern_offsets.push_back(
+          static_cast<uint32_t>(fast.patterns.size()));
     }
+
+    // closure(move(S, a)) is the union of the closures of every target;
+    // one move per byte class. Assertions are resolved against the byte
+    // about to be read, so word and non-word columns move from their own
+    // sets.
+    next_sets.assign(n_classes, StateSet(n));
+    auto move_from = [&](const StateSet &from, int only_context) {
+      from.for_each([&](size_t s) {
+        for (const auto &[cls, target] : idx.edges[s])
+          if (only_context < 0 || column_context[cls] == only_context)
+            next_sets[cls] |= idx.closures[target];
+      });
+    };
+    if (!idx.has_assertions)
+      move_from(current_set, -1);
+    else
+      for (Context next : {CONTEXT_WORD, CONTEXT_NON_WORD})
+        move_from(idx.resolve(current_set, prev, next), next);
+
+    fast.transitions.resize((i + 1) * fast.class_count, -1);
+    for (int c = 0; c < n_classes; c++)
+      if (!next_sets[c].empty())
+        fast.transitions[i * fast.class_count + c] =
+            state_of(next_sets[c], column_context[c]);
   }
 
+  return fast;
+}
+
+unique_ptr<DFA> NDFA::determinize() const {
+  if (!initial_state.has_value())
+    throw invalid_argument("NDFA initial state is not set");
+
+  const NDFAIndex idx = index();
+  if (idx.has_assertions)
+    throw invalid_argument("NDFA with assertions has no string-keyed DFA");
+  const DFA_Fast table = subset_construction(idx);
+  const int n_classes = idx.classes.count();
+
+  auto dfa = make_unique<DFA>();
+  dfa->set_byte_classes(idx.classes);
+
+  auto name = [](int s) { return "q" + to_string(s); };
+  for (int s = 0; s < table.size(); s++)
+    dfa->add_state(name(s), table.accept_states[s]);
+  dfa->mark_initial_state(name(table.initial_state));
+
   bool trap_created = false;
   string q_trap = "q_trap";
-  for (const auto &state : dfa->get_states()) {
-    for (char symbol : alphabet_clean) {
-      if (dfa->has_transition(state, symbol))
-        continue;
-      if (!trap_created) {
+  for (int s = 0; s < table.size(); s++) {
+    for (int c = 0; c < n_classes; c++) {
+      int t = table.transitions[s * table.class_count + c];
+      if (t < 0 && !trap_created) {
         dfa->add_state(q_trap);
-        for (char s : alphabet_clean)
-          dfa->add_transition(q_trap, s, q_trap);
+        for (int k = 0; k < n_classes; k++)
+          for (char symbol : idx.classes.members(k))
+            dfa->add_transition(q_trap, symbol, q_trap);
         trap_created = true;
       }
-      dfa->add_transition(state, symbol, q_trap);
+      string target = t < 0 ? q_trap : name(t);
+      for (char symbol : idx.classes.members(c))
+        dfa->add_transition(name(s), symbol, target);
     }
   }
 
   return dfa;
 }
+
+DFA_Fast NDFA::compile(size_t max_states) const {
+  if (!initial_state.has_value())
+    throw invalid_argument("NDFA initial state is not set");
+
+  return subset_construction(index(), max_states).minimize();
+}
@@ -68,6 +68,12 @@ Token Lexer::next_token() {
   case ')':
     advance();
     return Token(TOKEN_TYPE::CPAREN, ')');
+  case '^':
+  case '$': {
+    char c = current_char;
+    advance();
+    return Token(TOKEN_TYPE::ASSERTION, c);
+  }
 
   case '[': {
     advance();
@@ -121,6 +127,13 @@ Token Lexer::next_token() {
   }
 
   case '/': {
+    // /b and /B are word-boundary assertions outside a class only
+    if (peek(1) == 'b' || peek(1) == 'B') {
+      char kind = peek(1);
+      advance();
+      advance();
+      return Token(TOKEN_TYPE::ASSERTION, kind);
+    }
     char escaped = get_escaped_char();
     if (escaped == '\0')
       return Token(TOKEN_TYPE::INVALID);
@@ -164,11 +177,13 @@ Lexer::insert_implicit_concatenation(const vector<Token> &tokens) {
                             t1.get_type() == TOKEN_TYPE::CPAREN ||
                             t1.get_type() == TOKEN_TYPE::STAR ||
                             t1.get_type() == TOKEN_TYPE::PLUS ||
-                            t1.get_type() == TOKEN_TYPE::RANGE);
+                            t1.get_type() == TOKEN_TYPE::RANGE ||
+                            t1.get_type() == TOKEN_TYPE::ASSERTION);
 
       bool t2_starts_operand = (t2.get_type() == TOKEN_TYPE::LITERAL ||
                                 t2.get_type() == TOKEN_TYPE::OPAREN ||
-                                t2.get_type() == TOKEN_TYPE::RANGE);
+                                t2.get_type() == TOKEN_TYPE::RANGE ||
+                                t2.get_type() == TOKEN_TYPE::ASSERTION);
 
       if (t1_is_operand && t2_starts_operand)
         result.push_back(Token(TOKEN_TYPE::CONCAT, '.'));
@@ -55,6 +55,9 @@ string Token::to_string() const {
     return "LAMBDA(ε)";
   case TOKEN_TYPE::EMPTY:
     return "EMPTY(∅)";
+  case TOKEN_TYPE::ASSERTION:
+    return (value == 'b' || value == 'B') ? format("ASSERTION(/{})", value)
+                                          : format("ASSERTION({})", value);
   case TOKEN_TYPE::END:
     return "EOF";
   case TOKEN_TYPE::INVALID:
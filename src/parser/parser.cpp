@@ -94,6 +94,15 @@ shared_ptr<Regex> Parser::parse_atom(void) {
     eat(TOKEN_TYPE::EMPTY);
     return make_shared<Empty>();
   }
+  case TOKEN_TYPE::ASSERTION: {
+    char c = current.get_value();
+    Assertion kind = c == '^'   ? Assertion::LINE_START
+                     : c == '$' ? Assertion::LINE_END
+                     : c == 'b' ? Assertion::WORD_BOUNDARY
+                                : Assertion::NOT_WORD_BOUNDARY;
+    eat(TOKEN_TYPE::ASSERTION);
+    return make_shared<Assert>(kind);
+  }
   case TOKEN_TYPE::RANGE: {
     auto node = make_shared<fa::regex::Range>(current.get_char_class());
     eat(TOKEN_TYPE::RANGE);
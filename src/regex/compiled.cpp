@@ -0,0 +1,530 @@
+#include "../../include/fa/regex/compiled.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace fa::regex {
+
+/* Follows `state` while it has a single live transition on a single byte:
+   those bytes start every word accepted from it */
+static string required_prefix(const DFA_View &dfa, int state) {
+  string prefix;
+  vector<int> class_size(dfa.class_count, 0);
+  for (int b = 0; b < 256; b++)
+    class_size[dfa.byte_class[b]]++;
+
+  vector<bool> visited(dfa.size(), false);
+  while (!dfa.accept_states[state] && !visited[state]) {
+    visited[state] = true;
+    int only_class = -1, next = -1;
+    for (int c = 0; c < dfa.class_count; c++) {
+      int t = dfa.transitions[state * dfa.class_count + c];
+      if (t < 0)
+        continue;
+      if (only_class >= 0)
+        return prefix;
+      only_class = c;
+      next = t;
+    }
+    if (only_class < 0 || class_size[only_class] != 1)
+      return prefix;
+    for (int b = 0; b < 256; b++)
+      if (dfa.byte_class[b] == only_class)
+        prefix += static_cast<char>(b);
+    state = next;
+  }
+  return prefix;
+}
+
+/* Common to the walks from every live initial state, so it holds wherever
+   the match starts */
+static string required_prefix(const DFA_View &dfa) {
+  optional<string> common;
+  for (Context prev : {CONTEXT_EDGE, CONTEXT_WORD, CONTEXT_NON_WORD}) {
+    int start = dfa.initial(prev);
+    if (start < 0)
+      continue;
+    string prefix = required_prefix(dfa, start);
+    if (!common)
+      common = prefix;
+    else
+      common->resize(ranges::mismatch(*common, prefix).in1 - common->begin());
+  }
+  return common.value_or("");
+}
+
+struct CompiledRegex::Derived {
+  once_flag once;
+  bool given = false;      // passed to the constructor, never built here
+  optional<DFA_View> view; // empty until built, or if it did not fit
+  DFA_Fast table;          // owns the view's arrays when built here
+};
+
+static shared_ptr<CompiledRegex::Derived> given_table(DFA_Fast table) {
+  auto derived = make_shared<CompiledRegex::Derived>();
+  derived->given = true;
+  derived->table = move(table);
+  derived->view = derived->table.view();
+  return derived;
+}
+
+static shared_ptr<CompiledRegex::Derived>
+given_view(optional<DFA_View> view) {
+  auto derived = make_shared<CompiledRegex::Derived>();
+  derived->given = true;
+  derived->view = view;
+  return derived;
+}
+
+/* Runs `derive` on the anchored table once, from whichever thread asks
+   first; the others wait for it */
+static const DFA_View *
+derived_table(CompiledRegex::Derived &derived, const DFA_View &dfa,
+              DFA_Fast (DFA_Fast::*derive)(size_t) const) {
+  call_once(derived.once, [&] {
+    if (derived.given)
+      return;
+    try {
+      derived.table = (DFA_Fast::from_view(dfa).*derive)(
+          CompiledRegex::DERIVED_STATE_BUDGET);
+      derived.view = derived.table.view();
+    } catch (const length_error &) {
+      // Too large: callers fall back to the anchored table
+    }
+  });
+  return derived.view ? &*derived.view : nullptr;
+}
+
+CompiledRegex::CompiledRegex(DFA_Fast table, CompileOptions options,
+                             uint32_t pattern_count)
+    : CompiledRegex(make_shared<const DFA_Fast>(move(table)), options,
+                    pattern_count) {}
+
+CompiledRegex::CompiledRegex(shared_ptr<const DFA_Fast> table,
+                             CompileOptions options, uint32_t pattern_count)
+    : dfa(table->view()), search(make_shared<Derived>()),
+      reverse(make_shared<Derived>()), compile_options(options),
+      n_patterns(pattern_count) {
+  prefix = required_prefix(dfa);
+  storage = move(table);
+}
+
+CompiledRegex::CompiledRegex(DFA_Fast table, DFA_Fast search,
+                             DFA_Fast reverse, CompileOptions options,
+                             uint32_t pattern_count)
+    : search(given_table(move(search))), reverse(given_table(move(reverse))),
+      compile_options(options), n_patterns(pattern_count) {
+  auto owned = make_shared<const DFA_Fast>(move(table));
+  dfa = owned->view();
+  prefix = required_prefix(dfa);
+  storage = move(owned);
+}
+
+CompiledRegex::CompiledRegex(DFA_View table, optional<DFA_View> search,
+                             optional<DFA_View> reverse, string prefix,
+                             shared_ptr<const void> storage,
+                             CompileOptions options, uint32_t pattern_count)
+    : storage(move(storage)), dfa(table), search(given_view(search)),
+      reverse(given_view(reverse)), prefix(move(prefix)),
+      compile_options(options), n_patterns(pattern_count) {}
+
+const DFA_View *CompiledRegex::search_table() const {
+  return derived_table(*search, dfa, &DFA_Fast::unanchored);
+}
+
+const DFA_View *CompiledRegex::reverse_table() const {
+  return derived_table(*reverse, dfa, &DFA_Fast::reversed);
+}
+
+bool CompiledRegex::match(string_view word) const {
+  int curr = dfa.initial_state;
+  if (curr < 0 || !word.starts_with(prefix))
+    return false;
+
+  for (unsigned char symbol : word) {
+    curr = dfa.next(curr, symbol);
+    if (curr < 0)
+      return false;
+  }
+
+  return dfa.accepts(curr, CONTEXT_EDGE);
+}
+
+void CompiledRegex::match_many(span<const string_view> words,
+                               span<uint8_t> out) const {
+  const size_t bytes = (words.size() + 7) / 8;
+  if (out.size() < bytes)
+    throw invalid_argument("match_many: bitmap shorter than the words");
+  ranges::fill(out.first(bytes), 0);
+  if (dfa.initial_state < 0)
+    return;
+
+  constexpr size_t LANES = MATCH_LANES;
+  constexpr size_t BLOCK = 1024;  // words sorted together
+  constexpr size_t LONG = 64;     // lengths from here on share a bucket
+  const int *transitions = dfa.transitions;
+  const uint8_t *byte_class = dfa.byte_class;
+  const int classes = dfa.class_count;
+
+  // Sorted by length a block at a time, so the lanes of a group differ
+  // little in length while the words stay close together in memory
+  uint32_t order[BLOCK];
+  for (size_t base = 0; base < words.size(); base += BLOCK) {
+    const size_t n = min(BLOCK, words.size() - base);
+    uint32_t bucket[LONG + 1] = {};
+    for (size_t i = 0; i < n; i++)
+      bucket[min(words[base + i].size(), LONG)]++;
+    for (uint32_t len = 0, sum = 0; len <= LONG; len++)
+      sum += exchange(bucket[len], sum);
+    for (size_t i = 0; i < n; i++)
+      order[bucket[min(words[base + i].size(), LONG)]++] =
+          static_cast<uint32_t>(base + i);
+
+    for (size_t first = 0; first < n; first += LANES) {
+      const size_t lanes = min(LANES, n - first);
+      const unsigned char *data[LANES];
+      size_t length[LANES];
+      int state[LANES];
+      size_t shortest = SIZE_MAX;
+      for (size_t l = 0; l < LANES; l++) {
+        // Lanes past the last word are dead copies of the first
+        string_view word = words[order[first + (l < lanes ? l : 0)]];
+        data[l] = reinterpret_cast<const unsigned char *>(word.data());
+        length[l] = word.size();
+        state[l] = l < lanes && word.starts_with(prefix) ? dfa.initial_state
+                                                          : -1;
+        shortest = min(shortest, length[l]);
+      }
+
+      // Every lane has a byte up to the shortest length. A dead lane reads
+      // row 0 and stays at -1 without a branch (t | -1 == -1); the group
+      // stops once every state is negative.
+      size_t pos = 0;
+      for (; pos < shortest; pos++) {
+        int all = -1;
+        for (size_t l = 0; l < LANES; l++) {
+          int s = state[l];
+          int t = transitions[max(s, 0) * classes + byte_class[data[l][pos]]];
+          state[l] = t | (s >> 31);
+          all &= state[l];
+        }
+        if (all < 0) {
+          pos = shortest;
+          break;
+        }
+      }
+      for (size_t l = 0; l < lanes; l++) {
+        int curr = state[l];
+        for (size_t p = pos; curr >= 0 && p < length[l]; p++)
+          curr = dfa.next(curr, data[l][p]);
+        if (curr >= 0 && dfa.accepts(curr, CONTEXT_EDGE)) {
+          uint32_t i = order[first + l];
+          out[i / 8] |= uint8_t(1u << (i % 8));
+        }
+      }
+    }
+  }
+}
+
+bool CompiledRegex::match_from(string_view text, size_t start) const {
+  if (!text.substr(start).starts_with(prefix))
+    return false;
+  int curr = dfa.initial(start == 0 ? CONTEXT_EDGE
+                                    : context_of(text[start - 1]));
+  for (size_t pos = start; curr >= 0; pos++) {
+    if (pos == text.size())
+      return dfa.accepts(curr, CONTEXT_EDGE);
+    unsigned char symbol = text[pos];
+    if (dfa.accepts(curr, context_of(symbol)))
+      return true;
+    curr = dfa.next(curr, symbol);
+  }
+  return false;
+}
+
+bool CompiledRegex::contains(string_view text) const {
+  if (!prefix.empty() && text.find(prefix) == string_view::npos)
+    return false;
+
+  const DFA_View *search = search_table();
+  if (!search) {
+    for (size_t start = next_candidate(text, 0);;
+         start = next_candidate(text, start + 1)) {
+      if (match_from(text, start))
+        return true;
+      if (start >= text.size())
+        return false;
+    }
+  }
+
+  int curr = search->initial_state;
+  if (curr < 0)
+    return false;
+  for (unsigned char symbol : text) {
+    // A match ending here only counts if it accepts what follows
+    if (search->accepts(curr, context_of(symbol)))
+      return true;
+    curr = search->next(curr, symbol);
+    if (curr < 0)
+      return false;
+  }
+  return search->accepts(curr, CONTEXT_EDGE);
+}
+
+long CompiledRegex::longest_match_at(string_view text, size_t start) const {
+  if (start > text.size() || !text.substr(start).starts_with(prefix))
+    return -1;
+
+  Context prev = start == 0 ? CONTEXT_EDGE : context_of(text[start - 1]);
+  int curr = dfa.initial(prev);
+  long longest = -1;
+  for (size_t pos = start; curr >= 0; pos++) {
+    if (pos == text.size()) {
+      if (dfa.accepts(curr, CONTEXT_EDGE))
+        longest = static_cast<long>(pos - start);
+      break;
+    }
+    unsigned char symbol = text[pos];
+    if (dfa.accepts(curr, context_of(symbol)))
+      longest = static_cast<long>(pos - start);
+    curr = dfa.next(curr, symbol);
+  }
+  return longest;
+}
+
+void CompiledRegex::match_starts(string_view text,
+                                 span<uint64_t> bits) const {
+  ranges::fill(bits.first(text.size() / 64 + 1), 0);
+  const DFA_View *reverse = reverse_table();
+  if (!reverse) {
+    for (size_t i = 0; i <= text.size(); i++)
+      if (match_from(text, i))
+        bits[i / 64] |= uint64_t(1) << (i % 64);
+    return;
+  }
+
+  // Once the reverse automaton dies no match can begin further left
+  int curr = reverse->initial_state;
+  for (size_t i = text.size(); curr >= 0; i--) {
+    Context before = i == 0 ? CONTEXT_EDGE : context_of(text[i - 1]);
+    if (reverse->accepts(curr, before))
+      bits[i / 64] |= uint64_t(1) << (i % 64);
+    if (i == 0)
+      break;
+    curr = reverse->next(curr, text[i - 1]);
+  }
+}
+
+size_t CompiledRegex::match_lengths(string_view text,
+                                    span<uint32_t> lengths) const {
+  const size_t n = text.size();
+  ranges::fill(lengths.first(n), 0);
+  if (n == 0)
+    return 0;
+  vector<uint64_t> starts(n / 64 + 1);
+  match_starts(text, starts);
+
+  auto record = [&](size_t start, size_t end) {
+    lengths[start] =
+        static_cast<uint32_t>(min<size_t>(end - start, LONG_MATCH));
+  };
+
+  // Threads stay ordered by start, so the first to claim a state is the
+  // leftmost one there. `child` ends where `parent` does if the parent
+  // still matches at or after `at`, where they met.
+  struct Thread {
+    int state;
+    size_t start;
+  };
+  struct Merge {
+    size_t child, parent, at;
+  };
+  vector<Thread> threads, stepped;
+  vector<Merge> merges;
+  vector<size_t> claimed(dfa.size(), SIZE_MAX); // position of the claim
+  vector<size_t> owner(dfa.size());             // index of the claimer
+  size_t steps = 0;
+
+  for (size_t pos = 0;; pos++) {
+    if (pos < n && starts[pos / 64] >> (pos % 64) & 1) {
+      Context prev = pos == 0 ? CONTEXT_EDGE : context_of(text[pos - 1]);
+      int state = dfa.initial(prev);
+      if (state >= 0 && claimed[state] == pos) {
+        merges.push_back({pos, threads[owner[state]].start, pos});
+      } else if (state >= 0) {
+        claimed[state] = pos;
+        owner[state] = threads.size();
+        threads.push_back({state, pos});
+      }
+    }
+
+    Context next = pos == n ? CONTEXT_EDGE : context_of(text[pos]);
+    for (const Thread &thread : threads)
+      if (pos > thread.start && dfa.accepts(thread.state, next))
+        record(thread.start, pos);
+    if (pos == n)
+      break;
+
+    stepped.clear();
+    steps += threads.size();
+    for (const Thread &thread : threads) {
+      int state = dfa.next(thread.state, text[pos]);
+      if (state < 0)
+        continue;
+      if (claimed[state] == pos + 1) {
+        merges.push_back(
+            {thread.start, stepped[owner[state]].start, pos + 1});
+        continue;
+      }
+      claimed[state] = pos + 1;
+      owner[state] = stepped.size();
+      stepped.push_back({state, thread.start});
+    }
+    swap(threads, stepped);
+
+    // With no thread left, skip to the next start
+    if (threads.empty()) {
+      size_t word = (pos + 1) / 64;
+      uint64_t pending =
+          starts[word] & (~uint64_t(0) << ((pos + 1) % 64));
+      while (!pending && ++word < starts.size())
+        pending = starts[word];
+      if (!pending)
+        break;
+      pos = word * 64 + countr_zero(pending) - 1;
+    }
+  }
+
+  // A parent merges later than its children, or never
+  for (auto it = merges.rbegin(); it != merges.rend(); ++it) {
+    uint32_t length = lengths[it->parent];
+    if (length == LONG_MATCH) {
+      lengths[it->child] = LONG_MATCH;
+      continue;
+    }
+    size_t end = it->parent + length;
+    if (length && end >= it->at && end > it->child)
+      record(it->child, end);
+  }
+  return steps;
+}
+
+void CompiledRegex::find_all(string_view text, vector<MatchSpan> &out) const {
+  out.clear();
+  for (const MatchSpan &span : find_all(text))
+    out.push_back(span);
+}
+
+MatchRange::MatchRange(const CompiledRegex &regex, string_view text)
+    : regex(regex), text(text) {
+  if (!regex.contains(text))
+    return;
+  uint32_t *buffer = inline_lengths.data();
+  if (text.size() > INLINE_LENGTHS) {
+    heap_lengths = make_unique_for_overwrite<uint32_t[]>(text.size());
+    buffer = heap_lengths.get();
+  }
+  regex.match_lengths(text, span(buffer, text.size()));
+  lengths = buffer;
+}
+
+MatchRange::iterator::iterator(const MatchRange *range)
+    : range(range), done(!range->lengths) {
+  if (!done)
+    ++*this;
+}
+
+/* The next start at or after `from` with a non-empty match */
+MatchRange::iterator &MatchRange::iterator::operator++() {
+  const uint32_t *lengths = range->lengths;
+  const size_t size = range->text.size();
+  while (from < size && !lengths[from])
+    from++;
+  if (from == size) {
+    done = true;
+    return *this;
+  }
+  size_t length = lengths[from];
+  if (length == CompiledRegex::LONG_MATCH)
+    length = range->regex.longest_match_at(range->text, from);
+  current = {from, length};
+  from += length;
+  return *this;
+}
+
+void CompiledRegex::matching_patterns(string_view text,
+                                      vector<uint32_t> &out) const {
+  out.clear();
+  if (!dfa.has_patterns()) {
+    if (contains(text))
+      out.push_back(0);
+    return;
+  }
+  if (!prefix.empty() && text.find(prefix) == string_view::npos)
+    return;
+
+  // Ids are collected with repeats and deduplicated now and then, which
+  // also tells when every pattern has been seen
+  auto compact = [&] {
+    ranges::sort(out);
+    out.erase(unique(out.begin(), out.end()), out.end());
+  };
+  // Walks `table` from `curr` at `pos` until it dies or the text ends;
+  // true once every pattern is in `out`
+  auto scan = [&](const DFA_View &table, int curr, size_t pos) {
+    auto collect = [&](Context next) {
+      if (!table.accepts(curr, next))
+        return;
+      for (uint32_t entry : table.patterns_of(curr))
+        if (entry_accepts(entry, next))
+          out.push_back(entry_pattern(entry));
+    };
+    for (; curr >= 0; pos++) {
+      if (pos == text.size()) {
+        collect(CONTEXT_EDGE);
+        break;
+      }
+      unsigned char symbol = text[pos];
+      collect(context_of(symbol));
+      if (out.size() >= 2 * size_t(n_patterns)) {
+        compact();
+        if (out.size() == n_patterns)
+          return true;
+      }
+      curr = table.next(curr, symbol);
+    }
+    return false;
+  };
+
+  if (const DFA_View *search = search_table()) {
+    scan(*search, search->initial_state, 0);
+  } else {
+    for (size_t start = next_candidate(text, 0);;
+         start = next_candidate(text, start + 1)) {
+      Context prev = start == 0 ? CONTEXT_EDGE : context_of(text[start - 1]);
+      if (scan(dfa, dfa.initial(prev), start) || start >= text.size())
+        break;
+    }
+  }
+  compact();
+}
+
+size_t CompiledRegex::next_candidate(string_view text, size_t from) const {
+  if (prefix.empty() || from >= text.size())
+    return min(from, text.size());
+  size_t pos = text.find(prefix, from);
+  return pos == string_view::npos ? text.size() : pos;
+}
+
+} // namespace fa::regex
@@ -0,0 +1,128 @@
+#include "../../include/fa/regex/disk_cache.hpp"
+#include "../../include/fa/regex/serialize.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace fa::regex {
+
+static constexpr const char *ENTRY_EXTENSION = ".fa";
+
+// A temporary file this old was left by a store() that never finished
+static constexpr auto STALE_TMP_AGE = chrono::minutes(1);
+
+/* FNV-1a: stable across builds and runs, unlike std::hash */
+static uint64_t fnv1a(const string &bytes) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (unsigned char c : bytes) {
+    h ^= c;
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+DiskCache::DiskCache(fs::path dir, uintmax_t max_bytes)
+    : dir(move(dir)), max_bytes(max_bytes) {}
+
+fs::path DiskCache::default_dir() {
+  if (const char *xdg = getenv("XDG_CACHE_HOME"); xdg && *xdg)
+    return fs::path(xdg) / "mygrep";
+  if (const char *home = getenv("HOME"); home && *home)
+    return fs::path(home) / ".cache" / "mygrep";
+  return {};
+}
+
+string DiskCache::make_key(const string &pattern, const string &flags) {
+  return format("v{} {}\n{}\n{}", COMPILED_FORMAT_VERSION, ENGINE_VERSION,
+                flags, pattern);
+}
+
+fs::path DiskCache::entry_path(const string &key) const {
+  return dir / format("{:016x}{}", fnv1a(key), ENTRY_EXTENSION);
+}
+
+shared_ptr<const CompiledRegex> DiskCache::load(const string &key) const {
+  fs::path path = entry_path(key);
+  error_code ec;
+  if (!fs::exists(path, ec))
+    return nullptr;
+
+  shared_ptr<const CompiledRegex> regex;
+  try {
+    // The full key is stored in the entry: a file name collision is a miss
+    regex = load_compiled(path.string(), key);
+  } catch (const runtime_error &) {
+    fs::remove(path, ec);
+    return nullptr;
+  }
+
+  // Modification time doubles as the last use for eviction
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  return regex;
+}
+
+void DiskCache::store(const string &key, const CompiledRegex &regex) const {
+  fs::create_directories(dir);
+
+  fs::path path = entry_path(key);
+  fs::path tmp = path;
+  tmp += format(".tmp{}", getpid());
+  try {
+    save_compiled(regex, tmp.string(), key);
+    fs::rename(tmp, path);
+  } catch (...) {
+    error_code ec;
+    fs::remove(tmp, ec);
+    throw;
+  }
+
+  evict();
+}
+
+void DiskCache::evict() const {
+  error_code ec;
+  vector<tuple<fs::file_time_type, uintmax_t, fs::path>> entries;
+  uintmax_t total = 0;
+  const auto stale = fs::file_time_type::clock::now() - STALE_TMP_AGE;
+  for (const auto &item : fs::directory_iterator(dir, ec)) {
+    // Temporary files are "<entry>.tmp<pid>"; a fresh one may still be
+    // renamed into place, so it only counts towards the total
+    bool tmp = item.path().stem().extension() == ENTRY_EXTENSION &&
+               item.path().extension().string().starts_with(".tmp");
+    if (!tmp && item.path().extension() != ENTRY_EXTENSION)
+      continue;
+    uintmax_t size = item.file_size(ec);
+    if (ec)
+      continue;
+    fs::file_time_type time = item.last_write_time(ec);
+    if (tmp && time < stale && fs::remove(item.path(), ec))
+      continue;
+    if (!tmp)
+      entries.emplace_back(time, size, item.path());
+    total += size;
+  }
+  if (total <= max_bytes)
+    return;
+
+  sort(entries.begin(), entries.end());
+  for (const auto &[time, size, path] : entries) {
+    if (total <= max_bytes)
+      break;
+    if (fs::remove(path, ec))
+      total -= size;
+  }
+}
+
+} // namespace fa::regex
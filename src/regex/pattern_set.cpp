@@ -0,0 +1,118 @@
+#include "../../include/fa/regex/pattern_set.hpp"
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace fa::regex {
+
+PatternSet::PatternSet(const vector<shared_ptr<Regex>> &patterns,
+                       const CompileOptions &options, size_t state_budget)
+    : n_patterns(static_cast<uint32_t>(patterns.size())) {
+  auto slice = [&](size_t begin, size_t end) {
+    return vector<shared_ptr<Regex>>(patterns.begin() + begin,
+                                     patterns.begin() + end);
+  };
+
+  size_t begin = 0;
+  while (begin < patterns.size()) {
+    shared_ptr<const CompiledRegex> compiled;
+    size_t end = begin;
+    size_t grow = 1;
+    bool doubling = true;
+    while (end < patterns.size()) {
+      size_t next = min(patterns.size(), end + grow);
+      try {
+        compiled = compile_set(slice(begin, next), options, state_budget);
+        end = next;
+        if (doubling)
+          grow *= 2;
+      } catch (const length_error &) {
+        if (grow == 1)
+          break;
+        grow /= 2;
+        doubling = false;
+      }
+    }
+    if (end == begin) {
+      compiled = compile_set(slice(begin, begin + 1), options);
+      end = begin + 1;
+    }
+    shards.push_back({move(compiled), static_cast<uint32_t>(begin)});
+    begin = end;
+  }
+}
+
+PatternSet::PatternSet(shared_ptr<const CompiledRegex> compiled)
+    : n_patterns(compiled->pattern_count()) {
+  shards.push_back({move(compiled), 0});
+}
+
+PatternSet::PatternSet(vector<shared_ptr<const CompiledRegex>> compiled) {
+  for (auto &shard : compiled) {
+    uint32_t count = shard->pattern_count();
+    shards.push_back({move(shard), n_patterns});
+    n_patterns += count;
+  }
+}
+
+bool PatternSet::contains(string_view text) const {
+  for (const Shard &shard : shards)
+    if (shard.compiled->contains(text))
+      return true;
+  return false;
+}
+
+void PatternSet::matching_patterns(string_view text,
+                                   vector<uint32_t> &out) const {
+  out.clear();
+  vector<uint32_t> local;
+  for (const Shard &shard : shards) {
+    shard.compiled->matching_patterns(text, local);
+    for (uint32_t id : local)
+      out.push_back(shard.first_id + id);
+  }
+}
+
+void PatternSet::find_all(string_view text, vector<MatchSpan> &out) const {
+  if (shards.size() == 1) {
+    shards[0].compiled->find_all(text, out);
+    return;
+  }
+
+  out.clear();
+  vector<const CompiledRegex *> live;
+  for (const Shard &shard : shards)
+    if (shard.compiled->contains(text))
+      live.push_back(shard.compiled.get());
+  if (live.empty())
+    return;
+
+  // The longest match at a position is the longest of any shard's
+  vector<uint32_t> lengths(text.size(), 0), shard_lengths(text.size());
+  for (const CompiledRegex *compiled : live) {
+    compiled->match_lengths(text, shard_lengths);
+    for (size_t pos = 0; pos < text.size(); pos++)
+      lengths[pos] = max(lengths[pos], shard_lengths[pos]);
+  }
+
+  for (size_t pos = 0; pos < text.size(); pos++) {
+    if (!lengths[pos])
+      continue;
+    size_t length = lengths[pos];
+    if (length == CompiledRegex::LONG_MATCH) {
+      long longest = -1;
+      for (const CompiledRegex *compiled : live)
+        longest = max(longest, compiled->longest_match_at(text, pos));
+      length = longest;
+    }
+    out.push_back({pos, length});
+    pos += length - 1;
+  }
+}
+
+} // namespace fa::regex
@@ -2,12 +2,14 @@
 #include "../../include/fa/automata/dfa.hpp"
 #include "../../include/fa/automata/ndfa.hpp"
 #include <algorithm>
+#include <format>
 #include <memory>
+#include <mutex>
 #include <optional>
-#include <set>
+#include <span>
 #include <string>
 #include <string_view>
-#include <unordered_map>
+#include <vector>
 
 using namespace std;
 
@@ -15,121 +17,285 @@ namespace fa::regex {
 
 Regex::~Regex() = default;
 
-const DFA *Regex::dfa() const {
-  if (_dfa_cache == nullptr) {
-    unique_ptr<NDFA> ndfa = to_ndfa();
-    unique_ptr<DFA> dfa_det(ndfa->determinize());
-    _dfa_cache = dfa_det->minimize();
-  }
-  return _dfa_cache.get();
+static size_t hash_combine(size_t seed, size_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
 }
 
-static unique_ptr<DFA_Fast> build_fast_dfa(const DFA &dfa) {
-  auto fast = make_unique<DFA_Fast>();
-
-  const auto &initial_opt = dfa.get_inital_state();
-  if (!initial_opt.has_value())
-    return fast;
+shared_ptr<Regex> RegexTable::insert(shared_ptr<Regex> node) {
+  auto &bucket = buckets[node->hash()];
+  for (const auto &existing : bucket)
+    if (existing->equals(*node))
+      return existing;
+  bucket.push_back(node);
+  count++;
+  return node;
+}
 
-  unordered_map<string, int> state_index;
-  int idx = 0;
-  state_index[initial_opt.value()] = idx++;
+int ThompsonNFA::add_state() {
+  edges.emplace_back();
+  class_edges.emplace_back();
+  assertion_edges.emplace_back();
+  return static_cast<int>(edges.size()) - 1;
+}
 
-  const auto &trans = dfa.get_transitions();
-  for (const auto &[state, edges] : trans) {
-    if (!state_index.count(state))
-      state_index[state] = idx++;
-    for (const auto &[symbol, dst] : edges) {
-      if (!state_index.count(dst))
-        state_index[dst] = idx++;
-    }
-  }
+void ThompsonNFA::add_edge(int from, char symbol, int to) {
+  edges[from].emplace_back(symbol, to);
+}
 
-  fast->initial_state = 0;
+void ThompsonNFA::add_class_edge(int from, const bitset<256> &symbols,
+                                 int to) {
+  class_edges[from].emplace_back(symbols, to);
+}
 
-  fast->transitions.assign(idx, {});
-  for (auto &row : fast->transitions)
-    row.fill(-1);
+void ThompsonNFA::add_assertion_edge(int from, Assertion assertion, int to) {
+  assertion_edges[from].emplace_back(assertion, to);
+}
 
-  // Llenar transiciones (FUERA del loop anterior)
-  for (const auto &[state, edges] : trans) {
-    int from = state_index[state];
-    for (const auto &[symbol, dst] : edges) {
-      fast->transitions[from][(unsigned char)symbol] = state_index[dst];
-    }
+ThompsonNFA::Fragment ThompsonNFA::splice(const Fragment &fragment) {
+  const int shift = static_cast<int>(size()) - fragment.begin;
+  for (int s = fragment.begin; s < fragment.end; s++) {
+    int copy = add_state();
+    for (auto [symbol, to] : edges[s])
+      edges[copy].emplace_back(symbol, to + shift);
+    for (const auto &[symbols, to] : class_edges[s])
+      class_edges[copy].emplace_back(symbols, to + shift);
+    for (auto [assertion, to] : assertion_edges[s])
+      assertion_edges[copy].emplace_back(assertion, to + shift);
   }
 
-  fast->accept_states.assign(idx, false);
-  for (const auto &accept : dfa.get_final_states()) {
-    auto it = state_index.find(accept);
-    if (it != state_index.end())
-      fast->accept_states[it->second] = true;
+  Fragment copy = fragment;
+  copy.begin += shift;
+  copy.end += shift;
+  copy.entry += shift;
+  for (size_t i = 0; i < copy.exits.size(); i++) {
+    copy.exits[i] += shift;
+    edges[copy.exits[i]].resize(fragment.exit_edges[i]);
   }
+  return copy;
+}
 
-  return fast;
+size_t ThompsonNFA::edge_count() const {
+  size_t count = 0;
+  for (size_t s = 0; s < size(); s++)
+    count += edges[s].size() + class_edges[s].size() +
+             assertion_edges[s].size();
+  return count;
 }
 
-bool Regex::match(string_view word) const {
-  if (!_dfa_fast_cache) { // <-- ! aquí
-    const DFA *dfa_ptr = dfa();
-    if (!dfa_ptr)
-      return false;
-    if (!dfa_ptr->get_inital_state().has_value())
-      return false;
-    _dfa_fast_cache = build_fast_dfa(*dfa_ptr);
-    if (!_dfa_fast_cache || _dfa_fast_cache->initial_state < 0)
-      return false;
+unique_ptr<NDFA> ThompsonNFA::to_ndfa(const Fragment &root) const {
+  auto name = [](int s) { return format("q{}", s); };
+  auto ndfa = make_unique<NDFA>();
+  for (int s = 0; s < static_cast<int>(size()); s++)
+    ndfa->add_state(name(s));
+  for (int exit : root.exits)
+    ndfa->mark_final_state(name(exit));
+  ndfa->mark_initial_state(name(root.entry));
+
+  for (int s = 0; s < static_cast<int>(size()); s++) {
+    for (auto [symbol, to] : edges[s])
+      ndfa->add_transition(name(s), symbol, name(to));
+    for (const auto &[symbols, to] : class_edges[s])
+      ndfa->add_class_transition(name(s), symbols, name(to));
+    for (auto [assertion, to] : assertion_edges[s])
+      ndfa->add_assertion_transition(name(s), assertion, name(to));
   }
+  return ndfa;
+}
 
-  const DFA_Fast &fast = *_dfa_fast_cache;
-  int curr = fast.initial_state;
+unique_ptr<NDFA> Regex::to_ndfa() const {
+  ThompsonNFA nfa;
+  return nfa.to_ndfa(build_ndfa(nfa));
+}
 
-  for (unsigned char symbol : word) {
-    curr = fast.transitions[curr][symbol];
-    if (curr < 0)
-      return false;
-  }
+ThompsonNFA::Fragment Regex::to_ndfa(ThompsonNFA &nfa) const {
+  auto it = nfa.built.find(this);
+  if (it != nfa.built.end())
+    return nfa.splice(it->second);
+
+  ThompsonNFA::Fragment fragment = build_ndfa(nfa);
+  for (int exit : fragment.exits)
+    fragment.exit_edges.push_back(nfa.edges[exit].size());
+  nfa.built.emplace(this, fragment);
+  return fragment;
+}
+
+/* -w and -x become assertions around the pattern, so the DFA decides them
+   in the same pass as the pattern itself */
+static shared_ptr<Regex> surround(shared_ptr<Regex> tree, Assertion before,
+                                  Assertion after) {
+  return make_shared<Concat>(
+      make_shared<Concat>(make_shared<Assert>(before), move(tree)),
+      make_shared<Assert>(after));
+}
+
+/* [fold case] -> simplify -> [-w/-x assertions] -> hash-cons -> Thompson
+   with one fragment per distinct subtree */
+static unique_ptr<NDFA> compile_ndfa(const Regex &regex,
+                                     const CompileOptions &options = {}) {
+  shared_ptr<Regex> tree =
+      options.ignore_case ? regex.fold_case()->simplify() : regex.simplify();
+  if (options.word_regexp)
+    tree = surround(tree, Assertion::NOT_AFTER_WORD,
+                    Assertion::NOT_BEFORE_WORD);
+  if (options.line_regexp)
+    tree = surround(tree, Assertion::LINE_START, Assertion::LINE_END);
+  RegexTable table;
+  shared_ptr<Regex> root = tree->intern(table);
+  ThompsonNFA nfa;
+  return nfa.to_ndfa(root->to_ndfa(nfa));
+}
+
+const DFA *Regex::dfa() const {
+  call_once(_dfa_once, [this] {
+    unique_ptr<NDFA> ndfa = compile_ndfa(*this);
+    unique_ptr<DFA> dfa_det(ndfa->determinize());
+    _dfa_cache = dfa_det->minimize();
+  });
+  return _dfa_cache.get();
+}
+
+static DFA_Fast compile_table(const Regex &regex,
+                              const CompileOptions &options = {}) {
+  unique_ptr<NDFA> ndfa = compile_ndfa(regex, options);
+  return ndfa ? ndfa->compile() : DFA_Fast();
+}
+
+shared_ptr<const CompiledRegex>
+Regex::compile(const CompileOptions &options) const {
+  return make_shared<const CompiledRegex>(compile_table(*this, options),
+                                          options);
+}
 
-  return fast.accept_states[curr];
+const DFA_Fast *Regex::fast_dfa() const {
+  call_once(_compiled_once, [this] {
+    _fast_cache = make_shared<const DFA_Fast>(compile_table(*this));
+    _compiled_cache = make_shared<const CompiledRegex>(_fast_cache);
+  });
+  return _fast_cache.get();
+}
+
+bool Regex::match(string_view word) const {
+  fast_dfa();
+  return _compiled_cache->match(word);
+}
+
+void Regex::match_many(span<const string_view> words, span<uint8_t> out) const {
+  fast_dfa();
+  _compiled_cache->match_many(words, out);
 }
 
 /* EMPTY */
 
-unique_ptr<NDFA> Empty::to_ndfa(void) const {
-  auto res = make_unique<NDFA>();
+Empty::Empty() { _hash = 0xE0; }
 
-  res->add_state("q0", false);
-  res->mark_initial_state("q0");
-  return res;
+ThompsonNFA::Fragment Empty::build_ndfa(ThompsonNFA &nfa) const {
+  int q0 = nfa.add_state();
+  return {q0, q0 + 1, q0, {}, {}};
 }
 
 bool Empty::_atomic(void) const { return true; }
 
 string Empty::to_string(void) const { return "∅"; }
 
+shared_ptr<Regex> Empty::simplify(void) const { return make_shared<Empty>(); }
+
+bool Empty::equals(const Regex &other) const {
+  return dynamic_cast<const Empty *>(&other) != nullptr;
+}
+
+shared_ptr<Regex> Empty::intern(RegexTable &table) const {
+  return table.insert(make_shared<Empty>());
+}
+
+shared_ptr<Regex> Empty::fold_case(void) const { return make_shared<Empty>(); }
+
 /* LAMBDA */
 
-unique_ptr<NDFA> Lambda::to_ndfa(void) const {
-  auto res = make_unique<NDFA>();
-  res->add_state("q0", true);
-  res->mark_initial_state("q0");
-  return res;
+Lambda::Lambda() { _hash = 0x1A; }
+
+ThompsonNFA::Fragment Lambda::build_ndfa(ThompsonNFA &nfa) const {
+  int q0 = nfa.add_state();
+  return {q0, q0 + 1, q0, {q0}, {}};
 }
 
 bool Lambda::_atomic(void) const { return true; }
 
 string Lambda::to_string(void) const { return "λ"; }
 
+shared_ptr<Regex> Lambda::simplify(void) const { return make_shared<Lambda>(); }
+
+bool Lambda::equals(const Regex &other) const {
+  return dynamic_cast<const Lambda *>(&other) != nullptr;
+}
+
+shared_ptr<Regex> Lambda::intern(RegexTable &table) const {
+  return table.insert(make_shared<Lambda>());
+}
+
+shared_ptr<Regex> Lambda::fold_case(void) const {
+  return make_shared<Lambda>();
+}
+
+/* ASSERT */
+
+Assert::Assert(Assertion a) : kind(a) {
+  _hash = hash_combine(0xA5, static_cast<size_t>(a));
+}
+
+ThompsonNFA::Fragment Assert::build_ndfa(ThompsonNFA &nfa) const {
+  int q0 = nfa.add_state();
+  int q1 = nfa.add_state();
+  nfa.add_assertion_edge(q0, kind, q1);
+  return {q0, q1 + 1, q0, {q1}, {}};
+}
+
+bool Assert::_atomic(void) const { return true; }
+
+string Assert::to_string(void) const {
+  switch (kind) {
+  case Assertion::LINE_START:
+    return "^";
+  case Assertion::LINE_END:
+    return "$";
+  case Assertion::WORD_BOUNDARY:
+    return "/b";
+  case Assertion::NOT_WORD_BOUNDARY:
+    return "/B";
+  case Assertion::NOT_AFTER_WORD:
+    return "(?<!w)"; // -w only, no syntax of its own
+  case Assertion::NOT_BEFORE_WORD:
+    return "(?!w)";
+  }
+  return "";
+}
+
+shared_ptr<Regex> Assert::simplify(void) const {
+  return make_shared<Assert>(kind);
+}
+
+bool Assert::equals(const Regex &other) const {
+  auto o = dynamic_cast<const Assert *>(&other);
+  return o && o->kind == kind;
+}
+
+shared_ptr<Regex> Assert::intern(RegexTable &table) const {
+  return table.insert(make_shared<Assert>(kind));
+}
+
+shared_ptr<Regex> Assert::fold_case(void) const {
+  return make_shared<Assert>(kind);
+}
+
 /* CHAR */
-Char::Char(char c) : symbol(c) {}
+Char::Char(char c) : symbol(c) {
+  _hash = hash_combine(0xC4, static_cast<unsigned char>(c));
+}
 
-unique_ptr<NDFA> Char::to_ndfa(void) const {
-  auto res = make_unique<NDFA>();
-  res->add_state("q0");
-  res->add_state("q1", true);
-  res->add_transition("q0", symbol, "q1");
-  res->mark_initial_state("q0");
-  return res;
+ThompsonNFA::Fragment Char::build_ndfa(ThompsonNFA &nfa) const {
+  int q0 = nfa.add_state();
+  int q1 = nfa.add_state();
+  nfa.add_edge(q0, symbol, q1);
+  return {q0, q1 + 1, q0, {q1}, {}};
 }
 
 bool Char::_atomic(void) const { return true; }
@@ -141,73 +307,47 @@ string Char::to_string(void) const {
   return string(1, symbol);
 }
 
-/* CONCAT */
-
-Concat::Concat(shared_ptr<Regex> e1, shared_ptr<Regex> e2)
-    : expr1(e1), expr2(e2) {}
-
-static void cpy_states_concat(const unique_ptr<NDFA> &src, NDFA *dst,
-                              const string &prefix) {
-  if (!src || !dst)
-    return;
-
-  if (prefix == "EXPR1_") {
-    for (const auto &state : src->get_states()) {
-      dst->add_state(prefix + state, false);
-    }
-  } else if (prefix == "EXPR2_") {
-    set<string> final_states = src->get_final_states();
-    for (const auto &state : src->get_states()) {
-      bool is_final = final_states.find(state) != final_states.end();
-      dst->add_state(prefix + state, is_final);
-    }
-  }
+shared_ptr<Regex> Char::simplify(void) const {
+  /* '\0' is the epsilon symbol, so Char('\0') is λ */
+  if (symbol == '\0')
+    return make_shared<Lambda>();
+  return make_shared<Char>(symbol);
 }
 
-static void cpy_transitions(const unique_ptr<NDFA> &src, NDFA *dst,
-                            const string &prefix) {
-  if (!src || !dst)
-    return;
+bool Char::equals(const Regex &other) const {
+  auto o = dynamic_cast<const Char *>(&other);
+  return o && o->symbol == symbol;
+}
 
-  for (const auto &[state, trans] : src->get_transitions()) {
-    for (const auto &[symbol, to_states] : trans) {
-      for (const string &to_state : to_states) {
-        dst->add_transition(prefix + state, symbol, prefix + to_state);
-      }
-    }
-  }
+shared_ptr<Regex> Char::intern(RegexTable &table) const {
+  return table.insert(make_shared<Char>(symbol));
 }
 
-unique_ptr<NDFA> Concat::to_ndfa(void) const {
-  unique_ptr<NDFA> ndfa_expr1 = expr1->to_ndfa();
-  unique_ptr<NDFA> ndfa_expr2 = expr2->to_ndfa();
+shared_ptr<Regex> Char::fold_case(void) const {
+  CharClass both;
+  both.add_literal(symbol);
+  both.fold_case();
+  if (both.bits.count() == 1) // not a letter
+    return make_shared<Char>(symbol);
+  return make_shared<Range>(both);
+}
 
-  if (!ndfa_expr1 || !ndfa_expr2) {
-    return nullptr;
-  }
-  if (!ndfa_expr1->get_inital_state() || !ndfa_expr2->get_inital_state()) {
-    return nullptr;
-  }
+/* CONCAT */
 
-  auto new_ndfa = make_unique<NDFA>();
+Concat::Concat(shared_ptr<Regex> e1, shared_ptr<Regex> e2)
+    : expr1(e1), expr2(e2) {
+  _hash = hash_combine(hash_combine(0xCC, expr1->hash()), expr2->hash());
+}
 
-  /* Copy states and transitions */
-  cpy_states_concat(ndfa_expr1, new_ndfa.get(), "EXPR1_");
-  cpy_states_concat(ndfa_expr2, new_ndfa.get(), "EXPR2_");
-  cpy_transitions(ndfa_expr1, new_ndfa.get(), "EXPR1_");
-  cpy_transitions(ndfa_expr2, new_ndfa.get(), "EXPR2_");
+ThompsonNFA::Fragment Concat::build_ndfa(ThompsonNFA &nfa) const {
+  ThompsonNFA::Fragment left = expr1->to_ndfa(nfa);
+  ThompsonNFA::Fragment right = expr2->to_ndfa(nfa);
 
-  /*New initial state for new_ndfa*/
-  new_ndfa->mark_initial_state("EXPR1_" +
-                               ndfa_expr1->get_inital_state().value());
+  /* \0 represents epsilon or lambda transition */
+  for (int exit : left.exits)
+    nfa.add_edge(exit, '\0', right.entry);
 
-  string initial_expr2_new = "EXPR2_" + ndfa_expr2->get_inital_state().value();
-  for (const auto &final_state : ndfa_expr1->get_final_states()) {
-    new_ndfa->add_transition("EXPR1_" + final_state, '\0', initial_expr2_new);
-    /* \0 represents epsilon or lambda transition */
-  }
-
-  return new_ndfa;
+  return {left.begin, right.end, left.entry, right.exits, {}};
 }
 
 bool Concat::_atomic(void) const { return false; }
@@ -220,12 +360,51 @@ string Concat::to_string(void) const {
   return s1 + s2;
 }
 
+shared_ptr<Regex> Concat::simplify(void) const {
+  shared_ptr<Regex> s1 = expr1->simplify();
+  shared_ptr<Regex> s2 = expr2->simplify();
+
+  if (dynamic_pointer_cast<Empty>(s1) || dynamic_pointer_cast<Empty>(s2))
+    return make_shared<Empty>();
+  if (dynamic_pointer_cast<Lambda>(s1))
+    return s2;
+  if (dynamic_pointer_cast<Lambda>(s2))
+    return s1;
+  return make_shared<Concat>(s1, s2);
+}
+
+static bool same_node(const shared_ptr<Regex> &a, const shared_ptr<Regex> &b) {
+  return a == b || a->equals(*b);
+}
+
+bool Concat::equals(const Regex &other) const {
+  if (hash() != other.hash())
+    return false;
+  auto o = dynamic_cast<const Concat *>(&other);
+  return o && same_node(expr1, o->expr1) && same_node(expr2, o->expr2);
+}
+
+shared_ptr<Regex> Concat::intern(RegexTable &table) const {
+  return table.insert(
+      make_shared<Concat>(expr1->intern(table), expr2->intern(table)));
+}
+
+shared_ptr<Regex> Concat::fold_case(void) const {
+  return make_shared<Concat>(expr1->fold_case(), expr2->fold_case());
+}
+
 /* UNION */
 
 Union::Union(shared_ptr<Regex> e1, shared_ptr<Regex> e2)
-    : expr1(e1), expr2(e2) {}
+    : Union(vector<shared_ptr<Regex>>{e1, e2}) {}
+
+Union::Union(vector<shared_ptr<Regex>> alts) : alternatives(move(alts)) {
+  _hash = 0xAA;
+  for (const auto &alt : alternatives)
+    _hash = hash_combine(_hash, alt->hash());
+}
 
-static void cpy_states(const unique_ptr<NDFA> &src, NDFA *dst,
+static void cpy_states(const shared_ptr<const NDFA> &src, NDFA *dst,
                        const string &prefix) {
   if (!src || !dst)
     return;
@@ -235,94 +414,281 @@ static void cpy_states(const unique_ptr<NDFA> &src, NDFA *dst,
   }
 }
 
-unique_ptr<NDFA> Union::to_ndfa(void) const {
-  if (!expr1 || !expr2)
-    return nullptr;
-  unique_ptr<NDFA> ndfa_expr1 = expr1->to_ndfa();
-  unique_ptr<NDFA> ndfa_expr2 = expr2->to_ndfa();
+static void cpy_transitions(const shared_ptr<const NDFA> &src, NDFA *dst,
+                            const string &prefix) {
+  if (!src || !dst)
+    return;
 
-  if (!ndfa_expr1 || !ndfa_expr2) {
-    return nullptr;
+  for (const auto &[state, trans] : src->get_transitions()) {
+    for (const auto &[symbol, to_states] : trans) {
+      for (const string &to_state : to_states) {
+        dst->add_transition(prefix + state, symbol, prefix + to_state);
+      }
+    }
   }
 
-  if (!ndfa_expr1->get_inital_state() || !ndfa_expr2->get_inital_state()) {
-    return nullptr;
+  for (const auto &[state, edges] : src->get_class_transitions()) {
+    for (const auto &[symbols, to_state] : edges) {
+      dst->add_class_transition(prefix + state, symbols, prefix + to_state);
+    }
   }
 
-  auto new_ndfa = make_unique<NDFA>();
+  for (const auto &[state, edges] : src->get_assertion_transitions()) {
+    for (const auto &[assertion, to_state] : edges) {
+      dst->add_assertion_transition(prefix + state, assertion,
+                                    prefix + to_state);
+    }
+  }
+}
 
-  cpy_states(ndfa_expr1, new_ndfa.get(), "EXPR1_");
-  cpy_states(ndfa_expr2, new_ndfa.get(), "EXPR2_");
-  cpy_transitions(ndfa_expr1, new_ndfa.get(), "EXPR1_");
-  cpy_transitions(ndfa_expr2, new_ndfa.get(), "EXPR2_");
+/* One shared entry for every pattern of a set, and an exit of its own for
+   each, tagged with its index. Missing patterns never match but keep their
+   index. */
+static unique_ptr<NDFA>
+join_patterns(const vector<shared_ptr<const NDFA>> &ndfa_alts) {
+  auto new_ndfa = make_unique<NDFA>();
 
   string new_initial_state = "q0";
-  string new_final_state = "qf";
-
   new_ndfa->add_state(new_initial_state);
-  new_ndfa->add_state(new_final_state, true);
   new_ndfa->mark_initial_state(new_initial_state);
 
-  new_ndfa->add_transition(new_initial_state, '\0',
-                           "EXPR1_" + ndfa_expr1->get_inital_state().value());
-  new_ndfa->add_transition(new_initial_state, '\0',
-                           "EXPR2_" + ndfa_expr2->get_inital_state().value());
-
-  for (auto const &final_state : ndfa_expr1->get_final_states()) {
-    new_ndfa->add_transition("EXPR1_" + final_state, '\0', new_final_state);
-  }
-
-  for (auto const &final_state : ndfa_expr2->get_final_states()) {
-    new_ndfa->add_transition("EXPR2_" + final_state, '\0', new_final_state);
+  for (size_t i = 0; i < ndfa_alts.size(); i++) {
+    if (!ndfa_alts[i] || !ndfa_alts[i]->get_inital_state())
+      continue;
+    const string prefix = format("EXPR{}_", i + 1);
+    cpy_states(ndfa_alts[i], new_ndfa.get(), prefix);
+    cpy_transitions(ndfa_alts[i], new_ndfa.get(), prefix);
+
+    string exit = format("qf{}", i);
+    new_ndfa->add_state(exit, true);
+    new_ndfa->tag_final_state(exit, static_cast<uint32_t>(i));
+    new_ndfa->add_transition(new_initial_state, '\0',
+                             prefix + ndfa_alts[i]->get_inital_state().value());
+    for (auto const &final_state : ndfa_alts[i]->get_final_states()) {
+      new_ndfa->add_transition(prefix + final_state, '\0', exit);
+    }
   }
 
   return new_ndfa;
 }
 
+shared_ptr<const CompiledRegex>
+compile_set(const vector<shared_ptr<Regex>> &patterns,
+            const CompileOptions &options, size_t max_states) {
+  vector<shared_ptr<const NDFA>> ndfas;
+  for (const auto &pattern : patterns)
+    ndfas.push_back(pattern ? compile_ndfa(*pattern, options) : nullptr);
+  const uint32_t count = static_cast<uint32_t>(patterns.size());
+  DFA_Fast table = join_patterns(ndfas)->compile(max_states);
+  // Unbounded: the derived tables are built on first use, under their own
+  // budget
+  if (max_states == 0)
+    return make_shared<const CompiledRegex>(move(table), options, count);
+  DFA_Fast search = table.unanchored(max_states);
+  DFA_Fast reverse = table.reversed(max_states);
+  return make_shared<const CompiledRegex>(move(table), move(search),
+                                          move(reverse), options, count);
+}
+
+ThompsonNFA::Fragment Union::build_ndfa(ThompsonNFA &nfa) const {
+  /* One shared entry and one shared exit for every alternative */
+  int q0 = nfa.add_state();
+  vector<ThompsonNFA::Fragment> alts;
+  for (const auto &alt : alternatives)
+    alts.push_back(alt->to_ndfa(nfa));
+  int qf = nfa.add_state();
+
+  for (const auto &alt : alts) {
+    nfa.add_edge(q0, '\0', alt.entry);
+    for (int exit : alt.exits)
+      nfa.add_edge(exit, '\0', qf);
+  }
+  return {q0, qf + 1, q0, {qf}, {}};
+}
+
 bool Union::_atomic(void) const { return false; }
 
 string Union::to_string(void) const {
-  string s1 =
-      expr1->_atomic() ? expr1->to_string() : "(" + expr1->to_string() + ")";
-  string s2 =
-      expr2->_atomic() ? expr2->to_string() : "(" + expr2->to_string() + ")";
-  return s1 + "|" + s2;
+  string s;
+  for (size_t i = 0; i < alternatives.size(); i++) {
+    const auto &alt = alternatives[i];
+    if (i > 0)
+      s += "|";
+    s += alt->_atomic() ? alt->to_string() : "(" + alt->to_string() + ")";
+  }
+  return s;
 }
 
-/* STAR */
+/* Sequence of factors of a concatenation; λ is the empty sequence */
+static vector<shared_ptr<Regex>> concat_items(const shared_ptr<Regex> &expr) {
+  if (dynamic_pointer_cast<Lambda>(expr))
+    return {};
+  auto concat = dynamic_pointer_cast<Concat>(expr);
+  if (!concat)
+    return {expr};
+  vector<shared_ptr<Regex>> items = concat_items(concat->get_left());
+  vector<shared_ptr<Regex>> right = concat_items(concat->get_right());
+  items.insert(items.end(), right.begin(), right.end());
+  return items;
+}
 
-Star::Star(shared_ptr<Regex> e) : expr(e) {}
+static shared_ptr<Regex> make_concat(const vector<shared_ptr<Regex>> &items,
+                                     size_t begin, size_t end) {
+  if (begin >= end)
+    return make_shared<Lambda>();
+  shared_ptr<Regex> expr = items[begin];
+  for (size_t i = begin + 1; i < end; i++)
+    expr = make_shared<Concat>(expr, items[i]);
+  return expr;
+}
 
-unique_ptr<NDFA> Star::to_ndfa(void) const {
-  unique_ptr<NDFA> ndfa_expr = expr->to_ndfa();
-  if (!ndfa_expr)
-    return nullptr;
+/* Groups alternatives that start (or end) with the same factor:
+   xa|xb -> x(a|b) and ax|bx -> (a|b)x */
+static vector<shared_ptr<Regex>>
+factor_alternatives(const vector<shared_ptr<Regex>> &alts, bool prefix) {
+  vector<vector<shared_ptr<Regex>>> seqs;
+  for (const auto &alt : alts)
+    seqs.push_back(concat_items(alt));
+
+  auto edge = [&](size_t i) -> const Regex & {
+    return prefix ? *seqs[i].front() : *seqs[i].back();
+  };
+
+  vector<shared_ptr<Regex>> result;
+  vector<bool> used(alts.size(), false);
+  for (size_t i = 0; i < alts.size(); i++) {
+    if (used[i])
+      continue;
+    vector<size_t> group = {i};
+    if (!seqs[i].empty())
+      for (size_t j = i + 1; j < alts.size(); j++)
+        if (!used[j] && !seqs[j].empty() && edge(i).equals(edge(j))) {
+          group.push_back(j);
+          used[j] = true;
+        }
+
+    if (group.size() == 1) {
+      result.push_back(alts[i]);
+      continue;
+    }
 
-  auto init_opt = ndfa_expr->get_inital_state();
-  if (!init_opt) {
-    return nullptr;
+    vector<shared_ptr<Regex>> rests;
+    for (size_t g : group) {
+      const auto &seq = seqs[g];
+      rests.push_back(prefix ? make_concat(seq, 1, seq.size())
+                             : make_concat(seq, 0, seq.size() - 1));
+    }
+    shared_ptr<Regex> shared = prefix ? seqs[i].front() : seqs[i].back();
+    shared_ptr<Regex> rest = make_shared<Union>(rests)->simplify();
+    result.push_back(prefix ? make_shared<Concat>(shared, rest)->simplify()
+                            : make_shared<Concat>(rest, shared)->simplify());
   }
+  return result;
+}
 
-  auto new_ndfa = make_unique<NDFA>();
-  new_ndfa->add_state("q0", false);
-  new_ndfa->add_state("qf", true);
-  new_ndfa->mark_initial_state("q0");
+shared_ptr<Regex> Union::simplify(void) const {
+  /* Flatten nested unions, dropping ∅ and duplicates */
+  vector<shared_ptr<Regex>> alts;
+  auto add = [&](const shared_ptr<Regex> &alt) {
+    if (dynamic_pointer_cast<Empty>(alt))
+      return;
+    for (const auto &seen : alts)
+      if (seen->equals(*alt))
+        return;
+    alts.push_back(alt);
+  };
+  for (const auto &alt : alternatives) {
+    shared_ptr<Regex> simple = alt->simplify();
+    if (auto inner = dynamic_pointer_cast<Union>(simple))
+      for (const auto &inner_alt : inner->alternatives)
+        add(inner_alt);
+    else
+      add(simple);
+  }
 
-  cpy_states(ndfa_expr, new_ndfa.get(), "EXPR_");
-  cpy_transitions(ndfa_expr, new_ndfa.get(), "EXPR_");
+  /* Merge every single-character alternative into one Range */
+  CharClass merged;
+  size_t char_alts = 0;
+  for (const auto &alt : alts) {
+    if (auto c = dynamic_pointer_cast<Char>(alt)) {
+      merged.add_literal(static_cast<unsigned char>(c->get_symbol()));
+      char_alts++;
+    } else if (auto r = dynamic_pointer_cast<Range>(alt)) {
+      merged.bits |= r->get_char_class().effective();
+      char_alts++;
+    }
+  }
+  if (char_alts > 1) {
+    vector<shared_ptr<Regex>> rest;
+    bool placed = false;
+    for (const auto &alt : alts) {
+      if (dynamic_pointer_cast<Char>(alt) || dynamic_pointer_cast<Range>(alt)) {
+        if (!placed)
+          rest.push_back(make_shared<Range>(merged));
+        placed = true;
+      } else {
+        rest.push_back(alt);
+      }
+    }
+    alts = move(rest);
+  }
 
-  string prefixed_inner_init = "EXPR_" + init_opt.value();
+  if (alts.size() > 1)
+    alts = factor_alternatives(alts, true);
+  if (alts.size() > 1)
+    alts = factor_alternatives(alts, false);
 
-  new_ndfa->add_transition("q0", '\0', "qf");
-  new_ndfa->add_transition("q0", '\0', prefixed_inner_init);
+  if (alts.empty())
+    return make_shared<Empty>();
+  if (alts.size() == 1)
+    return alts.front();
+  return make_shared<Union>(alts);
+}
 
-  for (const auto &final_state : ndfa_expr->get_final_states()) {
-    string prefixed_f = "EXPR_" + final_state;
-    new_ndfa->add_transition(prefixed_f, '\0', "qf");
-    new_ndfa->add_transition(prefixed_f, '\0', prefixed_inner_init);
-  }
+bool Union::equals(const Regex &other) const {
+  if (hash() != other.hash())
+    return false;
+  auto o = dynamic_cast<const Union *>(&other);
+  if (!o || o->alternatives.size() != alternatives.size())
+    return false;
+  for (size_t i = 0; i < alternatives.size(); i++)
+    if (!same_node(alternatives[i], o->alternatives[i]))
+      return false;
+  return true;
+}
 
-  return new_ndfa;
+shared_ptr<Regex> Union::intern(RegexTable &table) const {
+  vector<shared_ptr<Regex>> alts;
+  for (const auto &alt : alternatives)
+    alts.push_back(alt->intern(table));
+  return table.insert(make_shared<Union>(alts));
+}
+
+shared_ptr<Regex> Union::fold_case(void) const {
+  vector<shared_ptr<Regex>> alts;
+  for (const auto &alt : alternatives)
+    alts.push_back(alt->fold_case());
+  return make_shared<Union>(alts);
+}
+
+/* STAR */
+
+Star::Star(shared_ptr<Regex> e) : expr(e) {
+  _hash = hash_combine(0x57, expr->hash());
+}
+
+ThompsonNFA::Fragment Star::build_ndfa(ThompsonNFA &nfa) const {
+  int q0 = nfa.add_state();
+  ThompsonNFA::Fragment inner = expr->to_ndfa(nfa);
+  int qf = nfa.add_state();
+
+  nfa.add_edge(q0, '\0', qf);
+  nfa.add_edge(q0, '\0', inner.entry);
+  for (int exit : inner.exits) {
+    nfa.add_edge(exit, '\0', qf);
+    nfa.add_edge(exit, '\0', inner.entry);
+  }
+  return {q0, qf + 1, q0, {qf}, {}};
 }
 
 bool Star::_atomic(void) const { return false; }
@@ -332,39 +698,50 @@ string Star::to_string(void) const {
                            : "(" + expr->to_string() + ")*";
 }
 
-/* PLUS */
-
-Plus::Plus(shared_ptr<Regex> e) : expr(e) {}
+shared_ptr<Regex> Star::simplify(void) const {
+  shared_ptr<Regex> inner = expr->simplify();
+  /* (x*)* = x*, (x+)* = x*, λ* = ∅* = λ */
+  if (dynamic_pointer_cast<Star>(inner))
+    return inner;
+  if (auto plus = dynamic_pointer_cast<Plus>(inner))
+    return make_shared<Star>(plus->get_expr());
+  if (dynamic_pointer_cast<Lambda>(inner) || dynamic_pointer_cast<Empty>(inner))
+    return make_shared<Lambda>();
+  return make_shared<Star>(inner);
+}
 
-unique_ptr<NDFA> Plus::to_ndfa(void) const {
-  unique_ptr<NDFA> ndfa_expr = expr->to_ndfa();
-  if (!ndfa_expr)
-    return nullptr;
+bool Star::equals(const Regex &other) const {
+  if (hash() != other.hash())
+    return false;
+  auto o = dynamic_cast<const Star *>(&other);
+  return o && same_node(expr, o->expr);
+}
 
-  auto init_opt = ndfa_expr->get_inital_state();
-  if (!init_opt) {
-    return nullptr;
-  }
+shared_ptr<Regex> Star::intern(RegexTable &table) const {
+  return table.insert(make_shared<Star>(expr->intern(table)));
+}
 
-  auto new_ndfa = make_unique<NDFA>();
-  new_ndfa->add_state("q0", false);
-  new_ndfa->add_state("qf", true);
-  new_ndfa->mark_initial_state("q0");
+shared_ptr<Regex> Star::fold_case(void) const {
+  return make_shared<Star>(expr->fold_case());
+}
 
-  cpy_states(ndfa_expr, new_ndfa.get(), "EXPR_");
-  cpy_transitions(ndfa_expr, new_ndfa.get(), "EXPR_");
+/* PLUS */
 
-  string prefixed_inner_init = "EXPR_" + init_opt.value();
+Plus::Plus(shared_ptr<Regex> e) : expr(e) {
+  _hash = hash_combine(0x9F, expr->hash());
+}
 
-  new_ndfa->add_transition("q0", '\0', prefixed_inner_init);
+ThompsonNFA::Fragment Plus::build_ndfa(ThompsonNFA &nfa) const {
+  int q0 = nfa.add_state();
+  ThompsonNFA::Fragment inner = expr->to_ndfa(nfa);
+  int qf = nfa.add_state();
 
-  for (const auto &final_state : ndfa_expr->get_final_states()) {
-    string prefixed_f = "EXPR_" + final_state;
-    new_ndfa->add_transition(prefixed_f, '\0', "qf");
-    new_ndfa->add_transition(prefixed_f, '\0', prefixed_inner_init);
+  nfa.add_edge(q0, '\0', inner.entry);
+  for (int exit : inner.exits) {
+    nfa.add_edge(exit, '\0', qf);
+    nfa.add_edge(exit, '\0', inner.entry);
   }
-
-  return new_ndfa;
+  return {q0, qf + 1, q0, {qf}, {}};
 }
 
 bool Plus::_atomic(void) const { return false; }
@@ -374,27 +751,42 @@ string Plus::to_string(void) const {
                            : "(" + expr->to_string() + ")+";
 }
 
-Range::Range(const CharClass &char_class) : cls(char_class) {}
+shared_ptr<Regex> Plus::simplify(void) const {
+  shared_ptr<Regex> inner = expr->simplify();
+  /* (x*)+ = x*, (x+)+ = x+, λ+ = λ, ∅+ = ∅ */
+  if (dynamic_pointer_cast<Star>(inner) || dynamic_pointer_cast<Plus>(inner) ||
+      dynamic_pointer_cast<Lambda>(inner) || dynamic_pointer_cast<Empty>(inner))
+    return inner;
+  return make_shared<Plus>(inner);
+}
 
-unique_ptr<NDFA> Range::to_ndfa() const {
-  unique_ptr<NDFA> new_ndfa = make_unique<NDFA>();
+bool Plus::equals(const Regex &other) const {
+  if (hash() != other.hash())
+    return false;
+  auto o = dynamic_cast<const Plus *>(&other);
+  return o && same_node(expr, o->expr);
+}
 
-  if (!new_ndfa)
-    return new_ndfa;
+shared_ptr<Regex> Plus::intern(RegexTable &table) const {
+  return table.insert(make_shared<Plus>(expr->intern(table)));
+}
 
-  new_ndfa->add_state("q0");
-  new_ndfa->mark_initial_state("q0");
-  new_ndfa->add_state("q1", true);
+shared_ptr<Regex> Plus::fold_case(void) const {
+  return make_shared<Plus>(expr->fold_case());
+}
 
-  for (int i = 0; i < 256; i++) {
-    unsigned char c = static_cast<unsigned char>(i);
+Range::Range(const CharClass &char_class) : cls(char_class) {
+  _hash = hash_combine(0x7A, std::hash<bitset<256>>{}(cls.effective()));
+}
 
-    if (cls.matches(c)) {
-      new_ndfa->add_transition("q0", (char)c, "q1");
-    }
-  }
+ThompsonNFA::Fragment Range::build_ndfa(ThompsonNFA &nfa) const {
+  int q0 = nfa.add_state();
+  int q1 = nfa.add_state();
 
-  return new_ndfa;
+  /* One edge for the whole class instead of one per matching byte */
+  nfa.add_class_edge(q0, cls.effective(), q1);
+
+  return {q0, q1 + 1, q0, {q1}, {}};
 }
 
 bool Range::_atomic() const { return true; }
@@ -420,4 +812,27 @@ string Range::to_string() const {
   return s;
 }
 
+shared_ptr<Regex> Range::simplify() const {
+  if (cls.effective().none())
+    return make_shared<Empty>();
+  return make_shared<Range>(cls);
+}
+
+bool Range::equals(const Regex &other) const {
+  if (hash() != other.hash())
+    return false;
+  auto o = dynamic_cast<const Range *>(&other);
+  return o && o->cls.effective() == cls.effective();
+}
+
+shared_ptr<Regex> Range::intern(RegexTable &table) const {
+  return table.insert(make_shared<Range>(cls));
+}
+
+shared_ptr<Regex> Range::fold_case() const {
+  CharClass folded = cls;
+  folded.fold_case();
+  return make_shared<Range>(folded);
+}
+
 } // namespace fa::regex
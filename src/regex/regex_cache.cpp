@@ -0,0 +1,88 @@
+#include "../../include/fa/regex/regex_cache.hpp"
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+namespace fa::regex {
+
+RegexCache::RegexCache(Parse parse, size_t max_table_bytes,
+                       size_t shard_count)
+    : parse(move(parse)), max_table_bytes(max_table_bytes),
+      shard_budget(max_table_bytes / max<size_t>(shard_count, 1)),
+      shards(max<size_t>(shard_count, 1)) {}
+
+static size_t view_bytes(const DFA_View &dfa) {
+  size_t bytes = 256 + size_t(dfa.state_count) * dfa.class_count * sizeof(int) +
+                 dfa.state_count;
+  if (dfa.has_patterns())
+    bytes += (size_t(dfa.state_count) + 1 +
+              dfa.pattern_offsets[dfa.state_count]) *
+             sizeof(uint32_t);
+  return bytes;
+}
+
+size_t RegexCache::table_bytes(const CompiledRegex &regex) {
+  size_t bytes = view_bytes(regex.table());
+  for (const DFA_View *derived : {regex.search_table(), regex.reverse_table()})
+    if (derived)
+      bytes += view_bytes(*derived);
+  return bytes;
+}
+
+shared_ptr<const CompiledRegex> RegexCache::get(const string &pattern,
+                                                const CompileOptions &options) {
+  Key key{options.letters(), parse(pattern)->simplify()};
+  Shard &shard = shards[KeyHash{}(key) % shards.size()];
+
+  {
+    lock_guard<mutex> guard(shard.lock);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+      hits++;
+      return it->second->second;
+    }
+  }
+
+  misses++;
+  shared_ptr<const CompiledRegex> compiled = key.tree->compile(options);
+  size_t bytes = table_bytes(*compiled);
+  if (bytes > shard_budget)
+    return compiled;
+
+  lock_guard<mutex> guard(shard.lock);
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) // compiled concurrently by another thread
+    return it->second->second;
+
+  while (!shard.lru.empty() && shard.bytes + bytes > shard_budget) {
+    shard.bytes -= table_bytes(*shard.lru.back().second);
+    shard.index.erase(shard.lru.back().first);
+    shard.lru.pop_back();
+    evictions++;
+  }
+  shard.lru.emplace_front(move(key), compiled);
+  shard.index.emplace(shard.lru.front().first, shard.lru.begin());
+  shard.bytes += bytes;
+  return compiled;
+}
+
+RegexCacheStats RegexCache::stats() const {
+  RegexCacheStats s;
+  s.hits = hits;
+  s.misses = misses;
+  s.evictions = evictions;
+  for (const Shard &shard : shards) {
+    lock_guard<mutex> guard(shard.lock);
+    s.entries += shard.lru.size();
+    s.table_bytes += shard.bytes;
+  }
+  return s;
+}
+
+} // namespace fa::regex
@@ -0,0 +1,85 @@
+#include "../../include/fa/regex/scanner.hpp"
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace fa::regex {
+
+Scanner::Scanner(shared_ptr<const CompiledRegex> regex, Callback on_match)
+    : regex(move(regex)), on_match(move(on_match)) {
+  if (!this->regex->search_table())
+    throw length_error("Scanner: search automaton exceeds the state budget");
+  state = this->regex->search_table()->initial_state;
+  line_done = state < 0;
+}
+
+void Scanner::end_line(uint64_t end) {
+  const DFA_View &search = *regex->search_table();
+  if (!line_done && search.accepts(state, CONTEXT_EDGE)) {
+    matched = true;
+    match_end = end;
+  }
+  if (matched)
+    on_match({line, line_start, end, match_end});
+
+  state = search.initial_state;
+  line_done = state < 0;
+  matched = false;
+  line++;
+  line_start = end + 1;
+}
+
+void Scanner::feed(span<const char> chunk) {
+  const DFA_View &search = *regex->search_table();
+  const char *p = chunk.data();
+  const char *end = p + chunk.size();
+  const uint64_t base = position;
+  position += chunk.size();
+
+  while (p < end) {
+    if (line_done) {
+      const void *newline = memchr(p, '\n', end - p);
+      if (!newline)
+        return;
+      p = static_cast<const char *>(newline);
+      end_line(base + (p - chunk.data()));
+      p++;
+      continue;
+    }
+
+    unsigned char symbol = *p;
+    if (symbol == '\n') {
+      end_line(base + (p - chunk.data()));
+      p++;
+      continue;
+    }
+    // A match ending here only counts if it accepts what follows
+    if (search.accepts(state, context_of(symbol))) {
+      matched = line_done = true;
+      match_end = base + (p - chunk.data());
+      continue;
+    }
+    state = search.next(state, symbol);
+    line_done = state < 0;
+    p++;
+  }
+}
+
+void Scanner::finish() {
+  if (position > line_start)
+    end_line(position);
+
+  const DFA_View &search = *regex->search_table();
+  state = search.initial_state;
+  line_done = state < 0;
+  matched = false;
+  position = 0;
+  line = 1;
+  line_start = 0;
+}
+
+} // namespace fa::regex
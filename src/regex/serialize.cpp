@@ -0,0 +1,272 @@
+#include "../../include/fa/regex/serialize.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace fa::regex {
+
+static_assert(sizeof(int) == sizeof(int32_t),
+              "DFA_Fast transitions are stored as int32_t");
+
+static constexpr char MAGIC[8] = {'F', 'A', 'D', 'F', 'A', '\0', '\0', '\0'};
+
+static uint64_t align_up(uint64_t offset, uint64_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t option_bits(const CompileOptions &options) {
+  return (options.ignore_case ? COMPILED_IGNORE_CASE : 0) |
+         (options.word_regexp ? COMPILED_WORD_REGEXP : 0) |
+         (options.line_regexp ? COMPILED_LINE_REGEXP : 0);
+}
+
+/* Lays out `dfa` from `offset` on; returns the end of its arrays */
+static uint64_t place_table(TableHeader &h, const DFA_View &dfa,
+                            uint64_t offset) {
+  h.initial_state = dfa.initial_state;
+  h.initial_after_word = dfa.initial_after_word;
+  h.initial_after_non_word = dfa.initial_after_non_word;
+  h.class_count = dfa.class_count;
+  h.state_count = dfa.state_count;
+  uint64_t cells = uint64_t(dfa.state_count) * dfa.class_count;
+  h.transitions_offset = align_up(offset, alignof(int32_t));
+  h.accept_offset = h.transitions_offset + cells * sizeof(int32_t);
+  memcpy(h.byte_class, dfa.byte_class, sizeof h.byte_class);
+  uint64_t end = h.accept_offset + dfa.state_count;
+  if (!dfa.has_patterns())
+    return end;
+
+  h.pattern_entries = dfa.pattern_offsets[dfa.state_count];
+  h.pattern_offsets_offset = align_up(end, alignof(uint32_t));
+  h.patterns_offset = h.pattern_offsets_offset +
+                      (uint64_t(dfa.state_count) + 1) * sizeof(uint32_t);
+  return h.patterns_offset + uint64_t(h.pattern_entries) * sizeof(uint32_t);
+}
+
+static void copy_table(string &image, const TableHeader &h,
+                       const DFA_View &dfa) {
+  uint64_t cells = uint64_t(dfa.state_count) * dfa.class_count;
+  if (cells)
+    memcpy(image.data() + h.transitions_offset, dfa.transitions,
+           cells * sizeof(int32_t));
+  if (dfa.state_count)
+    memcpy(image.data() + h.accept_offset, dfa.accept_states,
+           dfa.state_count);
+  if (dfa.has_patterns()) {
+    memcpy(image.data() + h.pattern_offsets_offset, dfa.pattern_offsets,
+           (uint64_t(dfa.state_count) + 1) * sizeof(uint32_t));
+    memcpy(image.data() + h.patterns_offset, dfa.patterns,
+           uint64_t(h.pattern_entries) * sizeof(uint32_t));
+  }
+}
+
+void save_compiled(const CompiledRegex &regex, const string &path,
+                   const string &key) {
+  const DFA_View &dfa = regex.table();
+  const DFA_View *search = regex.search_table();
+  const DFA_View *reverse = regex.reverse_table();
+  const string &prefix = regex.literal_prefix();
+
+  CompiledHeader header{};
+  memcpy(header.magic, MAGIC, sizeof MAGIC);
+  header.endian_tag = COMPILED_ENDIAN_TAG;
+  header.version = COMPILED_FORMAT_VERSION;
+  header.options = option_bits(regex.options());
+  header.prefix_size = static_cast<uint32_t>(prefix.size());
+  header.pattern_count = regex.pattern_count();
+  header.key_size = static_cast<uint32_t>(key.size());
+
+  uint64_t end = place_table(header.match, dfa, sizeof header);
+  header.tables = (search ? COMPILED_SEARCH_TABLE : 0) |
+                  (reverse ? COMPILED_REVERSE_TABLE : 0);
+  if (search)
+    end = place_table(header.search, *search, end);
+  if (reverse)
+    end = place_table(header.reverse, *reverse, end);
+  header.prefix_offset = end;
+  header.key_offset = header.prefix_offset + prefix.size();
+  header.file_size = header.key_offset + key.size();
+
+  string image(header.file_size, '\0');
+  memcpy(image.data(), &header, sizeof header);
+  copy_table(image, header.match, dfa);
+  if (search)
+    copy_table(image, header.search, *search);
+  if (reverse)
+    copy_table(image, header.reverse, *reverse);
+  memcpy(image.data() + header.prefix_offset, prefix.data(), prefix.size());
+  memcpy(image.data() + header.key_offset, key.data(), key.size());
+
+  ofstream out(path, ios::binary | ios::trunc);
+  out.write(image.data(), static_cast<streamsize>(image.size()));
+  out.close();
+  if (!out)
+    throw runtime_error(format("cannot write compiled automaton '{}'", path));
+}
+
+/* Header and bounds checks only: one pass over each table, so a corrupt
+   file cannot send next() outside the mapping */
+static void validate(const CompiledHeader &h, uint64_t size,
+                     const unsigned char *base, const string &path,
+                     const string &key) {
+  auto fail = [&](const char *why) {
+    throw runtime_error(format("'{}' is not a usable compiled automaton: {}",
+                               path, why));
+  };
+
+  if (memcmp(h.magic, MAGIC, sizeof MAGIC) != 0)
+    fail("bad magic");
+  if (h.endian_tag != COMPILED_ENDIAN_TAG)
+    fail("written with a different byte order");
+  if (h.version != COMPILED_FORMAT_VERSION)
+    fail("unsupported format version");
+  if (h.file_size != size)
+    fail("truncated");
+  if (h.options & ~(COMPILED_IGNORE_CASE | COMPILED_WORD_REGEXP |
+                    COMPILED_LINE_REGEXP))
+    fail("unknown compile options");
+  if (h.prefix_offset < sizeof h || h.prefix_offset + h.prefix_size > size ||
+      h.key_offset < sizeof h || h.key_offset + h.key_size > size)
+    fail("bad section offsets");
+  if (string_view(reinterpret_cast<const char *>(base + h.key_offset),
+                  h.key_size) != key)
+    fail("saved under another key");
+  if (h.tables & ~(COMPILED_SEARCH_TABLE | COMPILED_REVERSE_TABLE))
+    fail("unknown tables");
+
+  vector<const TableHeader *> tables = {&h.match};
+  if (h.tables & COMPILED_SEARCH_TABLE)
+    tables.push_back(&h.search);
+  if (h.tables & COMPILED_REVERSE_TABLE)
+    tables.push_back(&h.reverse);
+  for (const TableHeader *t : tables) {
+    if (t->class_count < 0 || t->class_count > 256 || t->state_count < 0)
+      fail("bad table dimensions");
+    for (int32_t initial : {t->initial_state, t->initial_after_word,
+                            t->initial_after_non_word})
+      if (initial < -1 || initial >= t->state_count)
+        fail("bad initial state");
+
+    uint64_t cells = uint64_t(t->state_count) * t->class_count;
+    if (t->transitions_offset % alignof(int32_t) != 0 ||
+        t->transitions_offset < sizeof h ||
+        t->transitions_offset + cells * sizeof(int32_t) > t->accept_offset ||
+        t->accept_offset + uint64_t(t->state_count) > size)
+      fail("bad section offsets");
+
+    for (int b = 0; b < 256; b++)
+      if (t->byte_class[b] >= t->class_count && t->state_count > 0)
+        fail("byte class out of range");
+
+    const int32_t *transitions =
+        reinterpret_cast<const int32_t *>(base + t->transitions_offset);
+    for (uint64_t i = 0; i < cells; i++)
+      if (transitions[i] < -1 || transitions[i] >= t->state_count)
+        fail("transition out of range");
+
+    if (t->pattern_offsets_offset == 0) {
+      if (t->pattern_entries != 0 || t->patterns_offset != 0)
+        fail("bad section offsets");
+      continue;
+    }
+    uint64_t offsets_end = t->pattern_offsets_offset +
+                           (uint64_t(t->state_count) + 1) * sizeof(uint32_t);
+    if (t->pattern_offsets_offset % alignof(uint32_t) != 0 ||
+        t->patterns_offset % alignof(uint32_t) != 0 ||
+        t->pattern_offsets_offset < t->accept_offset + t->state_count ||
+        offsets_end > t->patterns_offset ||
+        t->patterns_offset + uint64_t(t->pattern_entries) * sizeof(uint32_t) >
+            size)
+      fail("bad section offsets");
+
+    const uint32_t *offsets =
+        reinterpret_cast<const uint32_t *>(base + t->pattern_offsets_offset);
+    if (offsets[0] != 0 || offsets[t->state_count] != t->pattern_entries)
+      fail("bad pattern list");
+    for (int32_t s = 0; s < t->state_count; s++)
+      if (offsets[s] > offsets[s + 1])
+        fail("bad pattern list");
+    const uint32_t *patterns =
+        reinterpret_cast<const uint32_t *>(base + t->patterns_offset);
+    for (uint32_t i = 0; i < t->pattern_entries; i++)
+      if (entry_pattern(patterns[i]) >= h.pattern_count)
+        fail("pattern id out of range");
+  }
+}
+
+static DFA_View table_view(const TableHeader &h, const unsigned char *base) {
+  DFA_View dfa;
+  dfa.initial_state = h.initial_state;
+  dfa.initial_after_word = h.initial_after_word;
+  dfa.initial_after_non_word = h.initial_after_non_word;
+  dfa.class_count = h.class_count;
+  dfa.state_count = h.state_count;
+  dfa.byte_class = h.byte_class;
+  dfa.transitions = reinterpret_cast<const int *>(base + h.transitions_offset);
+  dfa.accept_states = base + h.accept_offset;
+  if (h.pattern_offsets_offset) {
+    dfa.pattern_offsets =
+        reinterpret_cast<const uint32_t *>(base + h.pattern_offsets_offset);
+    dfa.patterns = reinterpret_cast<const uint32_t *>(base + h.patterns_offset);
+  }
+  return dfa;
+}
+
+shared_ptr<const CompiledRegex> load_compiled(const string &path,
+                                              const string &key) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw runtime_error(format("cannot open compiled automaton '{}'", path));
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CompiledHeader)) {
+    close(fd);
+    throw runtime_error(
+        format("'{}' is not a usable compiled automaton: truncated", path));
+  }
+
+  size_t size = static_cast<size_t>(st.st_size);
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    throw runtime_error(format("cannot map compiled automaton '{}'", path));
+
+  shared_ptr<const void> mapping(
+      addr, [size](const void *p) { munmap(const_cast<void *>(p), size); });
+
+  const auto *base = static_cast<const unsigned char *>(addr);
+  const auto &header = *reinterpret_cast<const CompiledHeader *>(base);
+  validate(header, size, base, path, key);
+
+  string prefix(reinterpret_cast<const char *>(base + header.prefix_offset),
+                header.prefix_size);
+  CompileOptions options;
+  options.ignore_case = header.options & COMPILED_IGNORE_CASE;
+  options.word_regexp = header.options & COMPILED_WORD_REGEXP;
+  options.line_regexp = header.options & COMPILED_LINE_REGEXP;
+  auto derived = [&](const TableHeader &table,
+                     uint32_t bit) -> optional<DFA_View> {
+    if (!(header.tables & bit))
+      return nullopt;
+    return table_view(table, base);
+  };
+  return make_shared<const CompiledRegex>(
+      table_view(header.match, base),
+      derived(header.search, COMPILED_SEARCH_TABLE),
+      derived(header.reverse, COMPILED_REVERSE_TABLE), move(prefix),
+      move(mapping), options, header.pattern_count);
+}
+
+} // namespace fa::regex
@@ -1,6 +1,7 @@
 #include "../../include/fa/automata/dfa.hpp"
 #include "../../include/fa/automata/fa.hpp"
 #include "../../include/fa/automata/ndfa.hpp"
+#include <bitset>
 #include <cassert>
 #include <iostream>
 #include <memory>
@@ -144,6 +145,12 @@ void test_dfa_normalize() {
             << dfa.transitions_table() << std::endl;
 
   print_test("States normalized", dfa.size() == 4);
+  print_test("Initial state renamed to q0",
+             dfa.get_inital_state() == std::optional<std::string>("q0"));
+  print_test("Transitions follow the renamed states",
+             dfa.get_transitions().at("q0").at('a') != "middle" &&
+                 dfa.get_final_states().size() == 1 &&
+                 !dfa.get_states().contains("start"));
 }
 
 void test_dfa_complex_construction() {
@@ -299,6 +306,35 @@ void test_ndfa_normalize() {
             << nfa.transitions_table() << std::endl;
 
   print_test("States normalized", nfa.size() == 3);
+
+  NDFA edges;
+  edges.add_state("start");
+  edges.add_state("digit");
+  edges.add_state("end", true);
+  edges.mark_initial_state("start");
+  std::bitset<256> digits;
+  for (int c = '0'; c <= '9'; c++)
+    digits.set(c);
+  edges.add_class_transition("start", digits, "digit");
+  edges.add_assertion_transition("digit", Assertion::LINE_END, "end");
+  edges.tag_final_state("end", 7);
+
+  edges.normalize_states();
+
+  const auto &classes = edges.get_class_transitions();
+  const auto &assertions = edges.get_assertion_transitions();
+  print_test("Class edges follow the new names",
+             classes.size() == 1 && classes.contains("q0") &&
+                 edges.get_states().contains(classes.at("q0")[0].second));
+  print_test("Assertion edges follow the new names",
+             assertions.size() == 1 &&
+                 edges.get_states().contains(assertions.begin()->first) &&
+                 edges.get_final_states().contains(
+                     assertions.begin()->second[0].second));
+  print_test("Pattern tags follow the new names",
+             edges.get_final_patterns().size() == 1 &&
+                 edges.get_final_states().contains(
+                     edges.get_final_patterns().begin()->first));
 }
 
 void test_ndfa_complex_construction() {
@@ -1,5 +1,6 @@
 #include "../../include/fa/automata/dfa.hpp"
 #include "../../include/fa/automata/ndfa.hpp"
+#include <bitset>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -346,6 +347,82 @@ void test_ndfa_determinize_empty_language() {
   print_test("Empty language NDFA determinized", dfa != nullptr);
 }
 
+void test_ndfa_index_epsilon_closures() {
+  print_section("NDFA Index: Precomputed Epsilon Closures");
+
+  NDFA nfa;
+  nfa.add_state("q0");
+  nfa.add_state("q1");
+  nfa.add_state("q2");
+  nfa.add_state("q3", true);
+  nfa.mark_initial_state("q0");
+
+  nfa.add_transition("q0", EPSILON, "q1");
+  nfa.add_transition("q1", EPSILON, "q2");
+  nfa.add_transition("q2", EPSILON, "q0");
+  nfa.add_transition("q2", 'a', "q3");
+
+  NDFAIndex idx = nfa.index();
+
+  bool cycle_closed = true;
+  for (int s = 0; s < 3; s++)
+    for (int t = 0; t < 3; t++)
+      cycle_closed = cycle_closed && idx.closures[s].contains(t);
+
+  print_test("Closure follows an epsilon cycle", cycle_closed);
+  print_test("Closure does not cross symbol edges",
+             !idx.closures[0].contains(3));
+  print_test("Final state closure is itself",
+             idx.closures[3].contains(3) && !idx.closures[3].contains(0));
+
+  StateSet set(idx.names.size());
+  set.insert(3);
+  set.insert(1);
+  StateSet closure = idx.closure(set);
+  print_test("Closure of a set is the union of closures",
+             closure.contains(0) && closure.contains(2) && closure.contains(3));
+}
+
+void test_ndfa_determinize_class_edges() {
+  print_section("NDFA Determinize: Class Edges and Byte Classes");
+
+  std::bitset<256> lower;
+  for (int c = 'a'; c <= 'z'; c++)
+    lower.set(c);
+
+  NDFA nfa;
+  nfa.add_state("q0");
+  nfa.add_state("q1", true);
+  nfa.add_state("q2", true);
+  nfa.mark_initial_state("q0");
+
+  nfa.add_class_transition("q0", lower, "q1");
+  nfa.add_transition("q0", 'c', "q2");
+
+  std::cout << "\n"
+            << YELLOW << "Original NDFA:" << RESET << "\n"
+            << nfa.transitions_table() << std::endl;
+
+  NDFAIndex idx = nfa.index();
+  print_test("Alphabet split into [abd-z] and [c]",
+             idx.classes.count() == 2 &&
+                 idx.classes.class_of_byte('a') ==
+                     idx.classes.class_of_byte('z') &&
+                 idx.classes.class_of_byte('c') !=
+                     idx.classes.class_of_byte('d') &&
+                 idx.classes.class_of_byte('A') == -1);
+
+  std::unique_ptr<DFA> dfa = nfa.determinize();
+
+  std::cout << YELLOW << "Determinized DFA:" << RESET << "\n"
+            << dfa->transitions_table() << std::endl;
+
+  print_test("Every byte of a class has a transition",
+             dfa->has_transition("q0", 'a') && dfa->has_transition("q0", 'z'));
+  print_test("Bytes outside every class have no transition",
+             !dfa->has_transition("q0", 'A'));
+}
+
 int main() {
   std::cout << CYAN << "\n╔════════════════════════════════════════╗" << RESET
             << std::endl;
@@ -361,6 +438,7 @@ int main() {
   test_ndfa_determinize_chained_epsilon();
   test_ndfa_determinize_epsilon_closure();
   test_ndfa_determinize_epsilon_loop();
+  test_ndfa_index_epsilon_closures();
 
   test_ndfa_determinize_with_trap_state();
   test_ndfa_determinize_all_final();
@@ -369,6 +447,7 @@ int main() {
 
   test_ndfa_determinize_regex_pattern();
   test_ndfa_determinize_complete_alphabet();
+  test_ndfa_determinize_class_edges();
 
   std::cout << "\n"
             << CYAN << "════════════════════════════════════════" << RESET
@@ -152,6 +152,28 @@ void test_parentheses() {
   }
 }
 
+void test_assertions() {
+  print_section("Parser: Assertions");
+
+  try {
+    Parser parser("^a/b$");
+    auto regex = parser.parse();
+
+    std::cout << YELLOW "Input: '^a/b$'" RESET << std::endl;
+    std::cout << "Parsed: " << regex->to_string() << std::endl;
+
+    bool test1 = regex != nullptr;
+    bool test2 = regex->to_string() == "((^a)/b)$";
+    bool test3 = Parser("[/b]").parse()->to_string() == "[b]";
+
+    print_test("Assertions parsed", test1 && test2);
+    print_test("/b inside a class is a literal", test3);
+  } catch (const std::exception &e) {
+    std::cout << RED "Exception: " << e.what() << RESET << std::endl;
+    print_test("Assertions parsed", false);
+  }
+}
+
 void test_lambda() {
   print_section("Parser: Lambda");
 
@@ -383,6 +405,7 @@ int main() {
   test_plus();
   test_concatenation();
   test_parentheses();
+  test_assertions();
   test_lambda();
   test_empty();
 
@@ -0,0 +1,34 @@
+#ifndef AGREES_WITH_RUNTIME_HPP
+#define AGREES_WITH_RUNTIME_HPP
+
+#include "../../include/fa/parser/parser.hpp"
+#include "../../include/fa/regex/compiled.hpp"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Every word over `alphabet` up to `max_len` must get the same answer from
+// `Matcher::match` (a static_regex or a header written by fa_codegen) and
+// from Parser + Regex::compile()
+template <typename Matcher>
+bool agrees_with_runtime(const std::string &pattern,
+                         const std::string &alphabet, size_t max_len,
+                         const fa::regex::CompileOptions &options = {}) {
+  std::shared_ptr<const fa::regex::CompiledRegex> runtime =
+      Parser(pattern).parse()->compile(options);
+  std::vector<std::string> words{""};
+  for (size_t i = 0; i < words.size(); i++) {
+    if (Matcher::match(words[i]) != runtime->match(words[i])) {
+      std::cout << "\033[33mMismatch on '" << words[i] << "'\033[0m"
+                << std::endl;
+      return false;
+    }
+    if (words[i].size() < max_len)
+      for (char c : alphabet)
+        words.push_back(words[i] + c);
+  }
+  return true;
+}
+
+#endif // !AGREES_WITH_RUNTIME_HPP
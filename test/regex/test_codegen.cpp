@@ -0,0 +1,102 @@
+#include "../../include/fa/regex/compiled.hpp"
+#include "agrees_with_runtime.hpp"
+// Written by fa_codegen into $(CODEGEN_DIR) before this file is compiled
+#include "abb_suffix.hpp"
+#include "folded_severity.hpp"
+#include "log_prefix.hpp"
+#include "log_prefix_scan.hpp"
+#include "pairs.hpp"
+#include "unanchored_class.hpp"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define RESET "\033[0m"
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define CYAN "\033[36m"
+
+using namespace fa::regex;
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+void print_test(const std::string &name, bool passed) {
+  if (passed) {
+    std::cout << "[" GREEN "PASS" RESET "] " << name << std::endl;
+    tests_passed++;
+  } else {
+    std::cout << "[" RED "FAIL" RESET "] " << name << std::endl;
+    tests_failed++;
+  }
+}
+
+void print_section(const std::string &title) {
+  std::cout << "\n" CYAN "══════════════════════════════════════" RESET
+            << std::endl;
+  std::cout << CYAN "  " << title << RESET << std::endl;
+  std::cout << CYAN "══════════════════════════════════════" RESET << std::endl;
+}
+
+void test_generated_matches_runtime() {
+  print_section("fa_codegen: Same Language as the Runtime Engine");
+  print_test("ERR: [0-9]+", agrees_with_runtime<fa_generated::log_prefix>(
+                                "ERR: [0-9]+", "ER: 4x", 7));
+  print_test("--no-prefix-skip ERR: [0-9]+",
+             agrees_with_runtime<fa_generated::log_prefix_scan>(
+                 "ERR: [0-9]+", "ER: 4x", 7));
+  print_test("(ab|cd)+", agrees_with_runtime<fa_generated::pairs>(
+                             "(ab|cd)+", "abcd", 6));
+  print_test("--no-prefix-skip (a|b)*abb",
+             agrees_with_runtime<fa_generated::abb_suffix>("(a|b)*abb", "ab",
+                                                           9));
+  print_test("[^a-c]b|a+",
+             agrees_with_runtime<fa_generated::unanchored_class>(
+                 "[^a-c]b|a+", "abz", 6));
+
+  CompileOptions fold;
+  fold.ignore_case = true;
+  // Long enough to reach "warning"; each letter in one case only keeps
+  // the words few, and the cases are mixed across the alphabet
+  print_test("-i err|warn|warning",
+             agrees_with_runtime<fa_generated::folded_severity>(
+                 "err|warn|warning", "eRwAnIg", 7, fold));
+  print_test("-i accepts every alternative in any case",
+             fa_generated::folded_severity::match("Err") &&
+                 fa_generated::folded_severity::match("WARN") &&
+                 fa_generated::folded_severity::match("wArNiNg") &&
+                 !fa_generated::folded_severity::match("warnin"));
+}
+
+void test_generated_prefix() {
+  print_section("fa_codegen: Literal Prefix");
+  print_test("Prefix is emitted by default",
+             fa_generated::log_prefix::prefix == "ERR: ");
+  print_test("next_candidate() jumps to the prefix",
+             fa_generated::log_prefix::next_candidate("x ERR: 1", 0) == 2);
+  print_test("--no-prefix-skip leaves it empty",
+             fa_generated::log_prefix_scan::prefix.empty() &&
+                 fa_generated::abb_suffix::prefix.empty());
+}
+
+int main() {
+  std::cout << CYAN "\n╔════════════════════════════════════════╗" RESET
+            << std::endl;
+  std::cout << CYAN "║      TEST SUITE - Generated Matchers    ║" RESET
+            << std::endl;
+  std::cout << CYAN "╚════════════════════════════════════════╝" RESET
+            << std::endl;
+
+  test_generated_matches_runtime();
+  test_generated_prefix();
+
+  std::cout << "\n" CYAN "════════════════════════════════════════" RESET
+            << std::endl;
+  std::cout << GREEN "✓ Tests passed: " << tests_passed << RESET << std::endl;
+  std::cout << RED "✗ Tests failed: " << tests_failed << RESET << std::endl;
+  std::cout << CYAN "════════════════════════════════════════" RESET
+            << std::endl;
+
+  return tests_failed > 0 ? 1 : 0;
+}
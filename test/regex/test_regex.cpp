@@ -1,9 +1,21 @@
 #include "../../include/fa/automata/dfa.hpp"
 #include "../../include/fa/automata/ndfa.hpp"
+#include "../../include/fa/regex/disk_cache.hpp"
+#include "../../include/fa/regex/pattern_set.hpp"
 #include "../../include/fa/regex/regex.hpp"
+#include "../../include/fa/regex/regex_cache.hpp"
+#include "../../include/fa/regex/scanner.hpp"
+#include "../../include/fa/regex/serialize.hpp"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 #define RESET "\033[0m"
 #define GREEN "\033[32m"
@@ -313,6 +325,934 @@ void test_nested_operators() {
   print_test("((a|b)+)+ rejects empty", !nested_plus.match(""));
 }
 
+void test_range_classes() {
+  print_section("Range: Character Classes");
+  CharClass lower;
+  lower.add_range('a', 'z');
+  Range az(lower);
+  print_test("[a-z] accepts 'q'", az.match("q"));
+  print_test("[a-z] rejects 'Q'", !az.match("Q"));
+  print_test("[a-z] rejects empty", !az.match(""));
+
+  CharClass not_a;
+  not_a.add_literal('a');
+  not_a.negate = true;
+  auto not_a_range = make_shared<Range>(not_a);
+  Star not_a_star(not_a_range);
+  print_test("[^a] rejects empty", !Range(not_a).match(""));
+  print_test("[^a]* accepts 'xyz'", not_a_star.match("xyz"));
+  print_test("[^a]* rejects 'xay'", !not_a_star.match("xay"));
+  print_test("[^a]* minimizes to a single state", not_a_star.dfa()->size() == 1);
+}
+
+void test_fast_dfa() {
+  print_section("Fused Compile: NDFA to DFA_Fast");
+  auto a = make_shared<Char>('a');
+  auto b = make_shared<Char>('b');
+  auto a_or_b_star = make_shared<Star>(make_shared<Union>(a, b));
+  Concat pattern(make_shared<Concat>(make_shared<Concat>(a_or_b_star, a), b),
+                 b);
+  const DFA_Fast *fast = pattern.fast_dfa();
+  print_test("(a|b)*abb compiles to 4 states", fast->size() == 4);
+  print_test("Byte classes: a, b and everything else",
+             fast->class_count == 3);
+  print_test("(a|b)*abb accepts 'babb'", pattern.match("babb"));
+  print_test("(a|b)*abb rejects 'abab'", !pattern.match("abab"));
+  print_test("(a|b)*abb rejects 'abbc'", !pattern.match("abbc"));
+
+  Empty empty;
+  print_test("Empty compiles to the dead state",
+             empty.fast_dfa()->initial_state == -1);
+
+  Concat a_then_empty(a, make_shared<Empty>());
+  print_test("States that can never accept are dropped",
+             a_then_empty.fast_dfa()->size() == 0);
+}
+
+void test_simplify() {
+  print_section("Simplify: AST Canonicalization");
+  auto a = make_shared<Char>('a');
+  auto b = make_shared<Char>('b');
+  auto c = make_shared<Char>('c');
+  auto d = make_shared<Char>('d');
+
+  Union abc(make_shared<Union>(a, b), c);
+  print_test("a|b|c merges into [abc]", abc.simplify()->to_string() == "[abc]");
+  print_test("Merged union builds a smaller NDFA",
+             abc.simplify()->to_ndfa()->size() < abc.to_ndfa()->size());
+
+  Star a_star_star(make_shared<Star>(a));
+  print_test("(a*)* collapses to a*",
+             a_star_star.simplify()->to_string() == "a*");
+  Plus a_plus_star(make_shared<Star>(a));
+  print_test("(a*)+ collapses to a*",
+             a_plus_star.simplify()->to_string() == "a*");
+
+  auto ab = make_shared<Concat>(a, b);
+  Union prefix(make_shared<Concat>(ab, c), make_shared<Concat>(ab, d));
+  print_test("abc|abd factors to a(b[cd])",
+             prefix.simplify()->to_string() == "a(b[cd])");
+  Union suffix(make_shared<Concat>(a, c), make_shared<Concat>(b, c));
+  print_test("ac|bc factors to [ab]c",
+             suffix.simplify()->to_string() == "[ab]c");
+  print_test("Factored pattern still matches 'abd'", prefix.match("abd"));
+  print_test("Factored pattern rejects 'abe'", !prefix.match("abe"));
+
+  Union with_empty(make_shared<Empty>(), a);
+  print_test("∅|a simplifies to a", with_empty.simplify()->to_string() == "a");
+}
+
+void test_hash_consing() {
+  print_section("Hash-Consing: Shared Subtrees");
+  auto make_field = [] {
+    auto digit = make_shared<Range>([] {
+      CharClass cls;
+      cls.add_range('0', '9');
+      return cls;
+    }());
+    return make_shared<Concat>(make_shared<Plus>(digit),
+                               make_shared<Char>(':'));
+  };
+  auto field1 = make_field();
+  auto field2 = make_field();
+  print_test("Equal subtrees hash alike", field1->hash() == field2->hash());
+  print_test("Equal subtrees compare equal", field1->equals(*field2));
+  print_test("Different subtrees compare unequal",
+             !field1->equals(Concat(make_shared<Char>('a'),
+                                    make_shared<Char>(':'))));
+
+  Concat line(make_shared<Concat>(field1, field2), make_field());
+  RegexTable table;
+  auto interned = line.intern(table);
+  auto outer = dynamic_pointer_cast<Concat>(interned);
+  auto inner = dynamic_pointer_cast<Concat>(outer->get_left());
+  print_test("Interned copies share one node",
+             inner->get_left() == inner->get_right() &&
+                 inner->get_right() == outer->get_right());
+  print_test("Table holds only distinct subtrees", table.size() == 6);
+
+  ThompsonNFA nfa;
+  interned->to_ndfa(nfa);
+  print_test("One fragment per distinct subtree", nfa.fragment_count() == 6);
+  print_test("Shared fragments still match '1:22:333:'",
+             line.match("1:22:333:"));
+  print_test("Shared fragments reject '1:22:'", !line.match("1:22:"));
+
+  // n copies of one field: spliced blocks keep the NFA and its build linear
+  auto fields = [&](int n) {
+    shared_ptr<Regex> chain = field1;
+    for (int i = 1; i < n; i++)
+      chain = make_shared<Concat>(chain, field1);
+    return chain;
+  };
+  // Counted, not timed: a splice that copied the edges a parent added to
+  // its exits would add edges per level of nesting
+  auto build = [&](int n) {
+    shared_ptr<Regex> chain = fields(n);
+    RegexTable chain_table;
+    ThompsonNFA chain_nfa;
+    chain->intern(chain_table)->to_ndfa(chain_nfa);
+    return std::make_pair(chain_nfa.size(), chain_nfa.edge_count());
+  };
+  auto [small_states, small_edges] = build(500);
+  auto [large_states, large_edges] = build(4000);
+  print_test("4000 repeated fields take 6 NFA states each",
+             small_states == 6 * 500 && large_states == 6 * 4000);
+  print_test("And 7 edges each, less the exit of the last",
+             small_edges == 7 * 500 - 1 && large_edges == 7 * 4000 - 1);
+}
+
+void test_compiled_regex() {
+  print_section("CompiledRegex: Immutable Shared Matcher");
+  auto a = make_shared<Char>('a');
+  auto b = make_shared<Char>('b');
+  auto c = make_shared<Char>('c');
+  auto tail = make_shared<Star>(make_shared<Union>(b, c));
+  Concat pattern(make_shared<Concat>(make_shared<Concat>(a, b), c), tail);
+
+  shared_ptr<const CompiledRegex> compiled = pattern.compile();
+  print_test("Literal prefix is 'abc'", compiled->literal_prefix() == "abc");
+  print_test("Compiled accepts 'abcbc'", compiled->match("abcbc"));
+  print_test("Compiled rejects 'abb'", !compiled->match("abb"));
+  print_test("next_candidate jumps to the prefix",
+             compiled->next_candidate("xxabcxx", 0) == 2);
+  print_test("next_candidate returns size when absent",
+             compiled->next_candidate("xxabxx", 0) == 6);
+
+  Star no_prefix(a);
+  print_test("Accepting initial state has no prefix",
+             no_prefix.compile()->literal_prefix().empty());
+
+  vector<thread> workers;
+  atomic<int> agreed{0};
+  for (int t = 0; t < 4; t++)
+    workers.emplace_back([&] {
+      bool ok = true;
+      for (int i = 0; i < 1000; i++)
+        ok = ok && compiled->match("abccb") && !compiled->match("acb");
+      if (ok)
+        agreed++;
+    });
+  for (auto &w : workers)
+    w.join();
+  print_test("One CompiledRegex shared by 4 threads", agreed == 4);
+}
+
+static bool same_spans(const vector<MatchSpan> &got,
+                       const vector<pair<size_t, size_t>> &want) {
+  if (got.size() != want.size())
+    return false;
+  for (size_t i = 0; i < got.size(); i++)
+    if (got[i].start != want[i].first || got[i].length != want[i].second)
+      return false;
+  return true;
+}
+
+void test_state_budget() {
+  print_section("CompiledRegex: Derived Tables Under a State Budget");
+  // a(a|b)^16: the search automaton remembers where the last 17 'a's were
+  auto a = make_shared<Char>('a');
+  auto b = make_shared<Char>('b');
+  shared_ptr<Regex> wide = a;
+  for (int i = 0; i < 16; i++)
+    wide = make_shared<Concat>(wide, make_shared<Union>(a, b));
+  shared_ptr<const CompiledRegex> compiled = wide->compile();
+  std::string hit = "bb" + std::string(17, 'a') + "b";
+  print_test("Anchored match needs no search table",
+             compiled->match(std::string(17, 'a')));
+  print_test("Search table over the budget is not built",
+             compiled->search_table() == nullptr);
+  print_test("contains() runs the anchored table from each start",
+             compiled->contains(hit) && !compiled->contains("ab") &&
+                 !compiled->contains(std::string(20, 'b')));
+
+  auto set = compile_set({wide, make_shared<Char>('b')});
+  vector<uint32_t> ids;
+  set->matching_patterns(hit, ids);
+  print_test("Pattern ids without a search table",
+             set->search_table() == nullptr &&
+                 ids == vector<uint32_t>{0, 1});
+
+  // (a|b)^16 a, the mirror image: read right to left it has to remember
+  // the last 17 bytes, so only the reverse table is over the budget
+  shared_ptr<Regex> mirror = make_shared<Union>(a, b);
+  for (int i = 1; i < 16; i++)
+    mirror = make_shared<Concat>(mirror, make_shared<Union>(a, b));
+  mirror = make_shared<Concat>(mirror, a);
+  shared_ptr<const CompiledRegex> tail = mirror->compile();
+  std::string text = std::string(3, 'b') + std::string(17, 'a') + "b" +
+                     std::string(16, 'b') + "a";
+  vector<MatchSpan> spans;
+  tail->find_all(text, spans);
+  print_test("Reverse table over the budget is not built",
+             tail->search_table() != nullptr &&
+                 tail->reverse_table() == nullptr);
+  print_test("Spans found from the anchored table",
+             same_spans(spans, {{0, 17}, {21, 17}}));
+}
+
+void test_serialization() {
+  print_section("Serialization: Save and Map Compiled Automata");
+  auto a = make_shared<Char>('a');
+  auto b = make_shared<Char>('b');
+  CharClass cls;
+  cls.add_range('0', '9');
+  auto digits = make_shared<Range>(cls);
+  Concat pattern(make_shared<Concat>(a, b), make_shared<Plus>(digits));
+
+  auto path = std::filesystem::temp_directory_path() / "fa_test_compiled.bin";
+  shared_ptr<const CompiledRegex> compiled = pattern.compile();
+  save_compiled(*compiled, path.string());
+  shared_ptr<const CompiledRegex> loaded = load_compiled(path.string());
+
+  print_test("Loaded table keeps its size",
+             loaded->table().size() == compiled->table().size());
+  print_test("Loaded prefix is 'ab'", loaded->literal_prefix() == "ab");
+  print_test("Loaded accepts 'ab042'", loaded->match("ab042"));
+  print_test("Loaded rejects 'ab'", !loaded->match("ab"));
+  print_test("Loaded rejects 'abx1'", !loaded->match("abx1"));
+
+  Empty nothing;
+  save_compiled(*nothing.compile(), path.string());
+  print_test("Empty language round-trips",
+             !load_compiled(path.string())->match(""));
+
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << "FADFA";
+  bool rejected = false;
+  try {
+    load_compiled(path.string());
+  } catch (const std::runtime_error &) {
+    rejected = true;
+  }
+  print_test("Truncated file is rejected", rejected);
+  std::filesystem::remove(path);
+}
+
+void test_disk_cache() {
+  print_section("DiskCache: Compiled Automata Across Runs");
+  auto dir = std::filesystem::temp_directory_path() / "fa_test_cache";
+  std::filesystem::remove_all(dir);
+
+  Plus pattern(make_shared<Concat>(make_shared<Char>('a'),
+                                   make_shared<Char>('b')));
+  DiskCache cache(dir);
+  std::string key = DiskCache::make_key("(ab)+", "");
+  print_test("Flags are part of the key",
+             key != DiskCache::make_key("(ab)+", "i"));
+  print_test("Engine version is part of the key",
+             key.find(DiskCache::ENGINE_VERSION) != std::string::npos);
+  print_test("Key is the same for every build",
+             key == "v" + std::to_string(COMPILED_FORMAT_VERSION) + " " +
+                        DiskCache::ENGINE_VERSION + "\n\n(ab)+");
+  print_test("Miss before the first store", cache.load(key) == nullptr);
+
+  cache.store(key, *pattern.compile());
+  shared_ptr<const CompiledRegex> hit = cache.load(key);
+  print_test("Hit after store", hit != nullptr);
+  print_test("Cached automaton accepts 'abab'", hit && hit->match("abab"));
+
+  std::ofstream(cache.entry_path(key), std::ios::trunc) << "garbage";
+  print_test("Corrupt entry is a miss", cache.load(key) == nullptr);
+  print_test("Corrupt entry is removed",
+             !std::filesystem::exists(cache.entry_path(key)));
+
+  // Stand-in for a file name collision: another key's entry at this path
+  std::string colliding = DiskCache::make_key("(ab)+", "w");
+  cache.store(colliding, *pattern.compile());
+  std::filesystem::rename(cache.entry_path(colliding), cache.entry_path(key));
+  print_test("Entry stored under another key is a miss",
+             cache.load(key) == nullptr);
+
+  // Cap below two entries: storing a second one evicts the older
+  cache.store(key, *pattern.compile());
+  std::filesystem::last_write_time(
+      cache.entry_path(key),
+      std::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+  DiskCache small(dir, std::filesystem::file_size(cache.entry_path(key)) + 1);
+  std::string other = DiskCache::make_key("(ab)+", "x");
+  small.store(other, *pattern.compile());
+  print_test("LRU cap evicts the older entry",
+             !std::filesystem::exists(small.entry_path(key)) &&
+                 std::filesystem::exists(small.entry_path(other)));
+
+  // Left by writers that died: only the one past a minute is removed
+  auto orphan = cache.entry_path(key), writing = cache.entry_path(key);
+  orphan += ".tmp1";
+  writing += ".tmp2";
+  std::ofstream(orphan) << "partial";
+  std::ofstream(writing) << "partial";
+  std::filesystem::last_write_time(
+      orphan,
+      std::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+  cache.store(other, *pattern.compile());
+  print_test("Stale temporary file is removed",
+             !std::filesystem::exists(orphan) &&
+                 std::filesystem::exists(writing));
+
+  std::filesystem::remove_all(dir);
+}
+
+void test_regex_cache() {
+  print_section("RegexCache: Shared Compiled Patterns");
+  // Pattern "x|y" parses to x*|y*, enough to tell entries apart
+  auto parse = [](const std::string &pattern) {
+    vector<shared_ptr<Regex>> alts;
+    for (size_t i = 0; i < pattern.size(); i += 2)
+      alts.push_back(make_shared<Star>(make_shared<Char>(pattern[i])));
+    return shared_ptr<Regex>(make_shared<Union>(alts));
+  };
+
+  RegexCache cache(parse, 1 << 20, 4);
+  auto first = cache.get("a");
+  auto second = cache.get("a");
+  print_test("Second lookup shares the handle", first == second);
+  print_test("Same simplified tree shares the handle",
+             cache.get("a|a") == first &&
+                 cache.get("a|b|a") == cache.get("a|b"));
+  CompileOptions fold;
+  fold.ignore_case = true;
+  print_test("Options keep separate entries", cache.get("a", fold) != first);
+
+  RegexCacheStats stats = cache.stats();
+  print_test("Three hits, three misses",
+             stats.hits == 3 && stats.misses == 3);
+  print_test("Table bytes are accounted",
+             stats.entries == 3 &&
+                 stats.table_bytes == 2 * RegexCache::table_bytes(*first) +
+                                          RegexCache::table_bytes(
+                                              *cache.get("a|b")));
+
+  // Budget for a single entry: each new pattern evicts the previous one
+  RegexCache tiny(parse, RegexCache::table_bytes(*first), 1);
+  auto a = tiny.get("a");
+  tiny.get("b");
+  print_test("Over budget evicts the least recently used",
+             tiny.stats().evictions == 1 && tiny.stats().entries == 1);
+  print_test("Evicted handle stays usable", a->match("aaa"));
+
+  // One pattern as large as the cap, sixteen times a shard's share
+  RegexCache wide(parse, RegexCache::table_bytes(*first), 16);
+  wide.get("a");
+  wide.get("a");
+  print_test("Pattern over a shard's share is not cached",
+             wide.stats().misses == 2 && wide.stats().entries == 0 &&
+                 wide.stats().table_bytes == 0);
+  print_test("Derived tables are counted",
+             RegexCache::table_bytes(*first) >
+                 256 + size_t(first->table().size()) *
+                           first->table().class_count * sizeof(int));
+
+  vector<thread> workers;
+  atomic<int> agreed{0};
+  for (int t = 0; t < 4; t++)
+    workers.emplace_back([&, t] {
+      bool ok = true;
+      for (int i = 0; i < 500; i++) {
+        std::string p(1, static_cast<char>('a' + (i + t) % 8));
+        ok = ok && cache.get(p)->match(p + p);
+      }
+      if (ok)
+        agreed++;
+    });
+  for (auto &w : workers)
+    w.join();
+  print_test("Concurrent lookups from 4 threads", agreed == 4);
+  stats = cache.stats();
+  print_test("Counters add up",
+             stats.hits + stats.misses == 7 + 4 * 500 &&
+                 stats.entries == 10);
+}
+
+void test_ignore_case() {
+  print_section("Case Folding: -i Compiled into the Automaton");
+  CompileOptions fold;
+  fold.ignore_case = true;
+
+  Concat word(make_shared<Char>('a'), make_shared<Char>('1'));
+  auto folded = word.compile(fold);
+  print_test("'a1' accepts 'A1'", folded->match("A1"));
+  print_test("'a1' still accepts 'a1'", folded->match("a1"));
+  print_test("Options are recorded", folded->options().ignore_case);
+  print_test("Case-sensitive compile rejects 'A1'", !word.compile()->match("A1"));
+
+  CharClass lower;
+  lower.add_range('a', 'c');
+  auto range = Range(lower).compile(fold);
+  print_test("[a-c] accepts 'B'", range->match("B"));
+  print_test("[a-c] rejects 'D'", !range->match("D"));
+
+  CharClass not_a;
+  not_a.add_literal('a');
+  not_a.negate = true;
+  auto negated = Range(not_a).compile(fold);
+  print_test("[^a] rejects 'A' (folded before negation)",
+             !negated->match("A"));
+  print_test("[^a] accepts 'b'", negated->match("b"));
+
+  Char digit('7');
+  print_test("Non-letters stay a Char",
+             dynamic_cast<const Char *>(digit.fold_case().get()) != nullptr);
+}
+
+void test_assertions() {
+  print_section("Assertions: Anchors and Word Boundaries in the DFA");
+  auto word =
+      make_shared<Concat>(make_shared<Char>('o'), make_shared<Char>('k'));
+
+  Concat anchored(make_shared<Assert>(Assertion::LINE_START), word);
+  auto start = anchored.compile();
+  print_test("'^ok' contains 'ok!'", start->contains("ok!"));
+  print_test("'^ok' rejects 'not ok'", !start->contains("not ok"));
+  print_test("'^ok' has no state after a byte",
+             start->search_table()->initial_after_word < 0 &&
+                 start->search_table()->initial_after_non_word < 0);
+
+  Concat ended(word, make_shared<Assert>(Assertion::LINE_END));
+  print_test("'ok$' contains 'is ok'", ended.compile()->contains("is ok"));
+  print_test("'ok$' rejects 'ok?'", !ended.compile()->contains("ok?"));
+
+  Concat bounded(make_shared<Assert>(Assertion::WORD_BOUNDARY),
+                 make_shared<Concat>(word, make_shared<Assert>(
+                                               Assertion::WORD_BOUNDARY)));
+  auto boundary = bounded.compile();
+  print_test("'/bok/b' contains 'is ok.'", boundary->contains("is ok."));
+  print_test("'/bok/b' rejects 'book'", !boundary->contains("book"));
+  print_test("'/bok/b' match() sees the word ends", boundary->match("ok"));
+
+  Concat inner(make_shared<Assert>(Assertion::NOT_WORD_BOUNDARY), word);
+  print_test("'/Bok' contains 'book'", inner.compile()->contains("book"));
+  print_test("'/Bok' rejects 'ok'", !inner.compile()->contains("ok"));
+
+  CompileOptions words;
+  words.word_regexp = true;
+  auto w = word->compile(words);
+  print_test("-w finds 'ok' in 'say ok'", w->contains("say ok"));
+  print_test("-w rejects 'okay' and 'took'",
+             !w->contains("okay") && !w->contains("took"));
+  print_test("-w longest match sees the byte before",
+             w->longest_match_at("took ok", 2) < 0 &&
+                 w->longest_match_at("took ok", 5) == 2);
+
+  CompileOptions lines;
+  lines.line_regexp = true;
+  auto x = word->compile(lines);
+  print_test("-x accepts the whole line", x->contains("ok"));
+  print_test("-x rejects a longer line", !x->contains("ok ok"));
+
+  print_test("Plain pattern contains a substring",
+             word->compile()->contains("look"));
+  print_test("Empty match counts for '^'",
+             Assert(Assertion::LINE_START).compile()->contains("anything"));
+
+  bool threw = false;
+  try {
+    (void)anchored.to_ndfa()->determinize();
+  } catch (const std::invalid_argument &) {
+    threw = true;
+  }
+  print_test("String-keyed determinize() rejects assertions", threw);
+
+  std::string path = (std::filesystem::temp_directory_path() /
+                      "fa_test_assertions.fa")
+                         .string();
+  save_compiled(*w, path);
+  auto loaded = load_compiled(path);
+  print_test("Round trip keeps -w and the search table",
+             loaded->options().word_regexp && loaded->contains("say ok") &&
+                 !loaded->contains("okay"));
+  std::filesystem::remove(path);
+}
+
+void test_find_all() {
+  print_section("Match Spans: Leftmost-Longest in One Forward Pass");
+  vector<MatchSpan> spans;
+
+  CharClass digits;
+  digits.add_range('0', '9');
+  auto number = Plus(make_shared<Range>(digits)).compile();
+  number->find_all("a1 22 333b", spans);
+  print_test("[0-9]+ in 'a1 22 333b'",
+             same_spans(spans, {{1, 1}, {3, 2}, {6, 3}}));
+  number->find_all("none", spans);
+  print_test("No match leaves no spans", spans.empty());
+
+  // Leftmost wins over earliest end: 'b|abcd' on 'abcd' is the whole word
+  Union shortest(make_shared<Char>('b'),
+                 make_shared<Concat>(
+                     make_shared<Concat>(make_shared<Char>('a'),
+                                         make_shared<Char>('b')),
+                     make_shared<Concat>(make_shared<Char>('c'),
+                                         make_shared<Char>('d'))));
+  shortest.compile()->find_all("abcd b", spans);
+  print_test("Leftmost-longest, not earliest end",
+             same_spans(spans, {{0, 4}, {5, 1}}));
+
+  Star as(make_shared<Char>('a'));
+  as.compile()->find_all("baab", spans);
+  print_test("Empty matches are skipped", same_spans(spans, {{1, 2}}));
+
+  CompileOptions words;
+  words.word_regexp = true;
+  auto ok =
+      make_shared<Concat>(make_shared<Char>('o'), make_shared<Char>('k'));
+  ok->compile(words)->find_all("ok took ok.", spans);
+  print_test("-w spans", same_spans(spans, {{0, 2}, {8, 2}}));
+
+  Concat anchored(make_shared<Assert>(Assertion::LINE_START), ok);
+  anchored.compile()->find_all("okok", spans);
+  print_test("'^ok' spans only the start", same_spans(spans, {{0, 2}}));
+
+  // 'a|a*b' on a run of a's: every position starts a one-byte match, but
+  // a thread stays alive to the end of the run waiting for a 'b'.
+  // Extending each start on its own took time quadratic in the run.
+  auto a = make_shared<Char>('a');
+  auto a_or_ab = Union(a, make_shared<Concat>(make_shared<Star>(a),
+                                              make_shared<Char>('b')))
+                     .compile();
+  auto steps = [&](size_t n) {
+    vector<uint32_t> lengths(n);
+    return a_or_ab->match_lengths(std::string(n, 'a'), lengths);
+  };
+  a_or_ab->find_all(std::string(20000, 'a'), spans);
+  bool all_single = spans.size() == 20000 && spans.back().start == 19999;
+  a_or_ab->find_all(std::string(160000, 'a'), spans);
+  all_single = all_single && spans.size() == 160000 &&
+               spans.back().length == 1;
+  print_test("Run of a's under 'a|a*b' gives one span per byte", all_single);
+  size_t small = steps(20000), large = steps(160000);
+  print_test("Threads merge: steps grow linearly with the run",
+             large <= 160000 * size_t(a_or_ab->table().size()) &&
+                 large < 9 * small);
+  a_or_ab->find_all(std::string(1000, 'a') + "b", spans);
+  print_test("'a...ab' is one span", same_spans(spans, {{0, 1001}}));
+
+  // Against extending every start, on texts where threads meet and part
+  auto longest_each = [](const CompiledRegex &regex, const std::string &t) {
+    vector<MatchSpan> out;
+    for (size_t pos = 0; pos < t.size(); pos++) {
+      long length = regex.longest_match_at(t, pos);
+      if (length > 0) {
+        out.push_back({pos, static_cast<size_t>(length)});
+        pos += length - 1;
+      }
+    }
+    return out;
+  };
+  auto b = make_shared<Char>('b');
+  auto c = make_shared<Char>('c');
+  auto ab = make_shared<Concat>(a, b);
+  vector<shared_ptr<Regex>> patterns = {
+      make_shared<Union>(a, make_shared<Concat>(make_shared<Star>(a), b)),
+      make_shared<Concat>(make_shared<Union>(ab, a),
+                          make_shared<Union>(make_shared<Concat>(b, c), c)),
+      make_shared<Plus>(make_shared<Union>(ab, make_shared<Concat>(b, a))),
+      make_shared<Concat>(make_shared<Star>(make_shared<Concat>(a, a)), b),
+      make_shared<Concat>(make_shared<Assert>(Assertion::WORD_BOUNDARY),
+                          make_shared<Plus>(a)),
+      // No match can start at the edge: every start follows a byte
+      make_shared<Concat>(make_shared<Assert>(Assertion::NOT_WORD_BOUNDARY),
+                          make_shared<Plus>(a)),
+      make_shared<Union>(make_shared<Concat>(a, make_shared<Star>(b)),
+                         make_shared<Concat>(make_shared<Star>(b), c))};
+  unsigned seed = 7;
+  bool agrees = true;
+  for (const auto &pattern : patterns) {
+    auto compiled = pattern->compile();
+    for (int round = 0; round < 200; round++) {
+      std::string t;
+      for (int i = 0; i < 40; i++) {
+        seed = seed * 1103515245 + 12345;
+        t += " abc"[seed >> 16 & 3];
+      }
+      compiled->find_all(t, spans);
+      vector<MatchSpan> want = longest_each(*compiled, t);
+      vector<pair<size_t, size_t>> pairs;
+      for (const MatchSpan &span : want)
+        pairs.emplace_back(span.start, span.length);
+      agrees = agrees && same_spans(spans, pairs);
+    }
+  }
+  print_test("Spans agree with extending every start", agrees);
+
+  std::string path =
+      (std::filesystem::temp_directory_path() / "fa_test_spans.fa").string();
+  save_compiled(*number, path);
+  load_compiled(path)->find_all("x 12 y 3", spans);
+  print_test("Loaded automaton finds the same spans",
+             same_spans(spans, {{2, 2}, {7, 1}}));
+  std::filesystem::remove(path);
+}
+
+static shared_ptr<Regex> word(const std::string &w) {
+  shared_ptr<Regex> tree = make_shared<Char>(w[0]);
+  for (size_t i = 1; i < w.size(); i++)
+    tree = make_shared<Concat>(tree, make_shared<Char>(w[i]));
+  return tree;
+}
+
+void test_pattern_sets() {
+  print_section("Pattern Sets: One Automaton, Tagged Accepts");
+  vector<uint32_t> ids;
+
+  CharClass digits;
+  digits.add_range('0', '9');
+  auto set = compile_set({word("foo"), word("bar"),
+                          make_shared<Plus>(make_shared<Range>(digits))});
+  print_test("Set knows its size", set->pattern_count() == 3);
+  print_test("Set contains any member", set->contains("xbarx") &&
+                                            set->contains("7") &&
+                                            !set->contains("fob"));
+
+  set->matching_patterns("foo 42 foo", ids);
+  print_test("'foo 42 foo' matches patterns 0 and 2",
+             ids == vector<uint32_t>{0, 2});
+  set->matching_patterns("barfoo", ids);
+  print_test("'barfoo' matches patterns 0 and 1",
+             ids == vector<uint32_t>{0, 1});
+  set->matching_patterns("nothing", ids);
+  print_test("No pattern matches 'nothing'", ids.empty());
+
+  CompileOptions words;
+  words.word_regexp = true;
+  auto whole = compile_set({word("foo"), word("foobar")}, words);
+  whole->matching_patterns("foobar", ids);
+  print_test("-w applies per pattern", ids == vector<uint32_t>{1});
+
+  auto with_null = compile_set({nullptr, word("ab")});
+  with_null->matching_patterns("ab", ids);
+  print_test("A null pattern keeps its index", ids == vector<uint32_t>{1});
+
+  auto single = word("ab")->compile();
+  single->matching_patterns("xaby", ids);
+  print_test("A single pattern reports id 0", ids == vector<uint32_t>{0});
+
+  std::string path =
+      (std::filesystem::temp_directory_path() / "fa_test_set.fa").string();
+  save_compiled(*set, path);
+  auto loaded = load_compiled(path);
+  loaded->matching_patterns("bar 9", ids);
+  print_test("Loaded set keeps pattern ids",
+             loaded->pattern_count() == 3 && ids == vector<uint32_t>{1, 2});
+  std::filesystem::remove(path);
+}
+
+void test_sharded_sets() {
+  print_section("Pattern Sets: Sharding Under a State Budget");
+  vector<shared_ptr<Regex>> rules = {word("abcd"), word("cdef"), word("xyz"),
+                                     word("bc"), word("defgh")};
+  PatternSet whole(rules);
+  PatternSet sharded(rules, {}, 8);
+  print_test("Unbounded set is one shard", whole.shard_count() == 1);
+  print_test("Budget of 8 states splits it", sharded.shard_count() > 1);
+  print_test("Shards keep every pattern", sharded.pattern_count() == 5);
+
+  bool too_big = false;
+  try {
+    compile_set(rules, {}, 8);
+  } catch (const std::length_error &) {
+    too_big = true;
+  }
+  print_test("compile_set() reports an exceeded budget", too_big);
+
+  vector<uint32_t> ids, expected;
+  std::string text = "abcdefgh xyz";
+  whole.matching_patterns(text, expected);
+  sharded.matching_patterns(text, ids);
+  print_test("Sharded ids equal the single automaton's",
+             ids == expected && ids == vector<uint32_t>{0, 1, 2, 3, 4});
+
+  vector<MatchSpan> spans;
+  sharded.find_all(text, spans);
+  print_test("Sharded spans are leftmost-longest over the union",
+             same_spans(spans, {{0, 4}, {9, 3}}));
+  sharded.find_all("zbcdefghz", spans);
+  print_test("Spans from different shards interleave",
+             same_spans(spans, {{1, 2}, {3, 5}}));
+  print_test("Sharded set rejects unmatched text",
+             !sharded.contains("abdc fed"));
+
+  // As when every shard comes back from the disk cache
+  vector<shared_ptr<const CompiledRegex>> handles;
+  for (size_t i = 0; i < sharded.shard_count(); i++)
+    handles.push_back(sharded.shard_handle(i));
+  PatternSet rebuilt(handles);
+  rebuilt.matching_patterns(text, ids);
+  print_test("Set rebuilt from its shards keeps pattern ids",
+             rebuilt.pattern_count() == 5 && ids == expected);
+}
+
+static bool accepts_text(const DFA_Fast &dfa, const std::string &text) {
+  int curr = dfa.initial_state;
+  for (unsigned char c : text) {
+    if (curr < 0)
+      return false;
+    curr = dfa.next(curr, c);
+  }
+  return curr >= 0 && dfa.accepts(curr, CONTEXT_EDGE);
+}
+
+void test_boolean_queries() {
+  print_section("Boolean Queries: Product and Complement");
+  auto containing = [](const shared_ptr<Regex> &r,
+                       const CompileOptions &options = {}) {
+    return DFA_Fast::from_view(*r->compile(options)->search_table())
+        .containing();
+  };
+
+  DFA_Fast foo = containing(word("foo"));
+  print_test("containing() accepts 'a foo b'", accepts_text(foo, "a foo b"));
+  print_test("containing() rejects 'fo o'", !accepts_text(foo, "fo o"));
+
+  DFA_Fast not_foo = foo.complement();
+  print_test("complement() flips 'a foo b'",
+             !accepts_text(not_foo, "a foo b") &&
+                 accepts_text(not_foo, "fo o"));
+  print_test("complement() accepts the empty text",
+             accepts_text(not_foo, ""));
+
+  DFA_Fast query =
+      foo.intersect(containing(word("bar"))).intersect(
+          containing(word("qux")).complement());
+  print_test("foo AND bar AND NOT qux: 'bar foo'",
+             accepts_text(query, "bar foo"));
+  print_test("foo AND bar AND NOT qux: 'foo bar qux'",
+             !accepts_text(query, "foo bar qux"));
+  print_test("foo AND bar AND NOT qux: 'foo'", !accepts_text(query, "foo"));
+
+  CompileOptions words;
+  words.word_regexp = true;
+  DFA_Fast word_bar = containing(word("bar"), words);
+  print_test("-w holds inside containing()",
+             accepts_text(word_bar, "a bar") &&
+                 !accepts_text(word_bar, "abar"));
+
+  DFA_Fast nothing = foo.intersect(not_foo);
+  print_test("A AND NOT A is empty", nothing.size() == 0);
+}
+
+void test_scanner() {
+  print_section("Scanner: Chunk-Fed Line Search");
+  CharClass digits;
+  digits.add_range('0', '9');
+  auto number = make_shared<Concat>(word("id="),
+                                    make_shared<Plus>(make_shared<Range>(digits)));
+  auto compiled = number->compile();
+  const std::string text = "no\nid=42 ok\nid=\nlast id=7";
+
+  vector<ScanMatch> whole;
+  Scanner scanner(compiled,
+                  [&](const ScanMatch &m) { whole.push_back(m); });
+  scanner.feed(std::span(text));
+  scanner.finish();
+  print_test("Two matching lines", whole.size() == 2);
+  print_test("Line numbers 2 and 4",
+             whole.size() == 2 && whole[0].line == 2 && whole[1].line == 4);
+  print_test("Offsets of line 2",
+             whole.size() == 2 && whole[0].line_start == 3 &&
+                 whole[0].match_end == 7 && whole[0].line_end == 11);
+  print_test("Unterminated last line ends the stream",
+             whole.size() == 2 && whole[1].line_end == text.size() &&
+                 whole[1].match_end == text.size());
+
+  bool same = true;
+  for (size_t size = 1; size <= 5; size++) {
+    vector<ScanMatch> chunked;
+    Scanner pieces(compiled,
+                   [&](const ScanMatch &m) { chunked.push_back(m); });
+    for (size_t pos = 0; pos < text.size(); pos += size)
+      pieces.feed(std::span(text).subspan(pos, min(size, text.size() - pos)));
+    pieces.finish();
+    same = same && chunked.size() == whole.size();
+    for (size_t i = 0; same && i < whole.size(); i++)
+      same = chunked[i].line == whole[i].line &&
+             chunked[i].line_start == whole[i].line_start &&
+             chunked[i].line_end == whole[i].line_end &&
+             chunked[i].match_end == whole[i].match_end;
+  }
+  print_test("Chunks of 1 to 5 bytes give the same events", same);
+
+  CompileOptions words;
+  words.word_regexp = true;
+  vector<uint64_t> lines;
+  Scanner bounded(word("ab")->compile(words),
+                  [&](const ScanMatch &m) { lines.push_back(m.line); });
+  bounded.feed(std::span(std::string_view("ab")));
+  bounded.feed(std::span(std::string_view("c\nab")));
+  bounded.feed(std::span(std::string_view(" x\n")));
+  bounded.finish();
+  print_test("-w looks past a chunk boundary",
+             lines == vector<uint64_t>{2});
+}
+
+void test_match_range() {
+  print_section("Match Range: Lazy Spans, No Allocation per Match");
+  CharClass digits;
+  digits.add_range('0', '9');
+  auto number = Plus(make_shared<Range>(digits)).compile();
+
+  vector<MatchSpan> lazy;
+  for (MatchSpan span : number->find_all("a1 22 333b"))
+    lazy.push_back(span);
+  print_test("Range yields the find_all() spans",
+             same_spans(lazy, {{1, 1}, {3, 2}, {6, 3}}));
+
+  MatchRange none = number->find_all("no digits");
+  print_test("No match gives an empty range", none.begin() == none.end());
+
+  // Sparse starts on both sides of bitmap word boundaries
+  std::string text(1000, 'x');
+  vector<pair<size_t, size_t>> want;
+  for (size_t pos : {0, 62, 64, 127, 510, 512, 700, 998}) {
+    text[pos] = '7';
+    want.emplace_back(pos, 1);
+  }
+  text[999] = '7';
+  want.back().second = 2;
+  lazy.clear();
+  for (MatchSpan span : number->find_all(text))
+    lazy.push_back(span);
+  print_test("Spans across bitmap words of a long text",
+             same_spans(lazy, want));
+
+  vector<MatchSpan> eager;
+  number->find_all(text, eager);
+  print_test("Vector overload agrees with the range",
+             same_spans(eager, want));
+
+  // Last byte of the inline lengths, and the first text past them
+  bool edges = true;
+  for (size_t size : {MatchRange::INLINE_LENGTHS,
+                      MatchRange::INLINE_LENGTHS + 1}) {
+    std::string edge(size, 'x');
+    edge.back() = '7';
+    lazy.clear();
+    for (MatchSpan span : number->find_all(edge))
+      lazy.push_back(span);
+    edges = edges && same_spans(lazy, {{size - 1, 1}});
+  }
+  print_test("Match at the end of inline and heap lengths", edges);
+}
+
+void test_match_many() {
+  print_section("Match Many: Lockstep Batch of Words");
+  // [a-z]+[0-9]: a prefix-free table where lanes die at different bytes
+  CharClass letters, digits;
+  letters.add_range('a', 'z');
+  digits.add_range('0', '9');
+  auto id = make_shared<Concat>(make_shared<Plus>(make_shared<Range>(letters)),
+                                make_shared<Range>(digits));
+  auto compiled = id->compile();
+
+  vector<std::string> owned = {"abc1", "", "x9", "abc", "1abc", "hostname7",
+                               "q0", "zz", "a1b2", "verylongidentifier3",
+                               "m5"};
+  vector<std::string_view> words(owned.begin(), owned.end());
+  vector<uint8_t> bits((words.size() + 7) / 8, 0xFF);
+  compiled->match_many(words, bits);
+
+  bool agrees = true;
+  for (size_t i = 0; i < words.size(); i++)
+    agrees &= bool(bits[i / 8] >> (i % 8) & 1) == compiled->match(words[i]);
+  print_test("Bits agree with match() across two groups", agrees);
+  print_test("Bitmap is cleared past the last word", (bits[1] >> 3) == 0);
+
+  // Past one sort block, with lengths beyond the last length bucket
+  vector<std::string> many;
+  for (size_t i = 0; i < 2500; i++) {
+    std::string w(1 + i * 7 % 90, 'a' + i % 26);
+    if (i % 3)
+      w += char('0' + i % 10);
+    if (i % 11 == 0)
+      w[w.size() / 2] = '#';
+    many.push_back(w);
+  }
+  vector<std::string_view> many_views(many.begin(), many.end());
+  vector<uint8_t> many_bits((many.size() + 7) / 8);
+  compiled->match_many(many_views, many_bits);
+  agrees = true;
+  for (size_t i = 0; i < many.size(); i++)
+    agrees &= bool(many_bits[i / 8] >> (i % 8) & 1) == compiled->match(many[i]);
+  print_test("Bits agree with match() across sort blocks", agrees);
+
+  // Regex::match_many() runs on the cached matcher
+  vector<uint8_t> cached(bits.size());
+  id->match_many(words, cached);
+  print_test("Regex::match_many() gives the same bits", cached == bits);
+
+  vector<uint8_t> none(1, 0xFF);
+  compiled->match_many({}, none);
+  print_test("No words leave the bitmap untouched", none[0] == 0xFF);
+
+  bool threw = false;
+  try {
+    vector<uint8_t> small(1);
+    compiled->match_many(words, small);
+  } catch (const std::invalid_argument &) {
+    threw = true;
+  }
+  print_test("Short bitmap is rejected", threw);
+}
+
 int main() {
   std::cout << CYAN "\n╔════════════════════════════════════════╗" RESET
             << std::endl;
@@ -341,6 +1281,24 @@ int main() {
   test_complex_pattern_4();
   test_edge_cases();
   test_nested_operators();
+  test_range_classes();
+  test_fast_dfa();
+  test_simplify();
+  test_hash_consing();
+  test_compiled_regex();
+  test_state_budget();
+  test_serialization();
+  test_disk_cache();
+  test_regex_cache();
+  test_ignore_case();
+  test_assertions();
+  test_find_all();
+  test_pattern_sets();
+  test_sharded_sets();
+  test_boolean_queries();
+  test_scanner();
+  test_match_range();
+  test_match_many();
 
   std::cout << "\n" CYAN "════════════════════════════════════════" RESET
             << std::endl;
@@ -0,0 +1,90 @@
+#include "../../include/fa/regex/compiled.hpp"
+#include "../../include/fa/regex/static_regex.hpp"
+#include "agrees_with_runtime.hpp"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define RESET "\033[0m"
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define CYAN "\033[36m"
+
+using namespace fa::regex;
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+void print_test(const std::string &name, bool passed) {
+  if (passed) {
+    std::cout << "[" GREEN "PASS" RESET "] " << name << std::endl;
+    tests_passed++;
+  } else {
+    std::cout << "[" RED "FAIL" RESET "] " << name << std::endl;
+    tests_failed++;
+  }
+}
+
+void print_section(const std::string &title) {
+  std::cout << "\n" CYAN "══════════════════════════════════════" RESET
+            << std::endl;
+  std::cout << CYAN "  " << title << RESET << std::endl;
+  std::cout << CYAN "══════════════════════════════════════" RESET << std::endl;
+}
+
+// Checked while this file compiles
+using log_prefix = static_regex<"[A-Z]+: [0-9]+">;
+static_assert(log_prefix::match("ERR: 42"));
+static_assert(!log_prefix::match("err: 42"));
+static_assert(!log_prefix::match("ERR: "));
+static_assert(static_regex<"(a|b)*abb">::state_count == 4);
+static_assert(static_regex<"a/*b">::match("a*b"));
+static_assert(static_regex<"[^a-z]+">::match("A1 "));
+
+void test_static_matches_runtime() {
+  print_section("static_regex: Same Language as the Runtime Engine");
+  print_test("(a|b)*abb",
+             agrees_with_runtime<static_regex<"(a|b)*abb">>("(a|b)*abb", "ab",
+                                                            8));
+  print_test("(ab|cd)+", agrees_with_runtime<static_regex<"(ab|cd)+">>(
+                             "(ab|cd)+", "abcd", 6));
+  print_test("[0-9]+/.[0-9]",
+             agrees_with_runtime<static_regex<"[0-9]+/.[0-9]">>(
+                 "[0-9]+/.[0-9]", "1.x", 6));
+  print_test("(x*)*y", agrees_with_runtime<static_regex<"(x*)*y">>(
+                           "(x*)*y", "xy", 7));
+  print_test("[^a-c]b|a+", agrees_with_runtime<static_regex<"[^a-c]b|a+">>(
+                               "[^a-c]b|a+", "abz", 5));
+}
+
+void test_static_table() {
+  print_section("static_regex: Table Shape");
+  using abc = static_regex<"abc">;
+  print_test("'abc' has 4 states", abc::state_count == 4);
+  print_test("Table is usable as DFA_Fast",
+             CompiledRegex(abc::to_fast()).match("abc"));
+  print_test("DFA_Fast copy keeps the literal prefix",
+             CompiledRegex(abc::to_fast()).literal_prefix() == "abc");
+}
+
+int main() {
+  std::cout << CYAN "\n╔════════════════════════════════════════╗" RESET
+            << std::endl;
+  std::cout << CYAN "║      TEST SUITE - Static Regex          ║" RESET
+            << std::endl;
+  std::cout << CYAN "╚════════════════════════════════════════╝" RESET
+            << std::endl;
+
+  test_static_matches_runtime();
+  test_static_table();
+
+  std::cout << "\n" CYAN "════════════════════════════════════════" RESET
+            << std::endl;
+  std::cout << GREEN "✓ Tests passed: " << tests_passed << RESET << std::endl;
+  std::cout << RED "✗ Tests failed: " << tests_failed << RESET << std::endl;
+  std::cout << CYAN "════════════════════════════════════════" RESET
+            << std::endl;
+
+  return tests_failed > 0 ? 1 : 0;
+}